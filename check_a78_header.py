@@ -24,26 +24,14 @@ print(f'  ASCII: "{sig}"')
 print(f'  Hex: {" ".join(f"{b:02X}" for b in header[0:16])}')
 print()
 
-print(f'Byte 53 (cartridge type): 0x{header[53]:02X}')
-cart_types = {
-    0: 'Standard 7800',
-    1: 'SuperGame (bank-switched)',
-    2: 'SuperGame with RAM',
-    3: 'Absolute (F18 Hornet)',
-    4: 'Activision',
-}
-print(f'  Type: {cart_types.get(header[53], "Unknown")}')
-print()
-
-print(f'Byte 54 (controller 1): 0x{header[54]:02X}')
-print(f'Byte 55 (controller 2): 0x{header[55]:02X}')
-print()
-
-print(f'Byte 58 (TV format): 0x{header[58]:02X}')
-print(f'  Format: {"PAL" if header[58] == 1 else "NTSC"}')
-print()
-
-print(f'Byte 63 (save device): 0x{header[63]:02X}')
+# Decoded by the firmware and tools/bus_sim through include/a78_header.h;
+# `bus_sim --rom <file> --check-load` prints the same decode.
+cart_type = (header[53] << 8) | header[54]
+print(f'Bytes 49-52 (ROM size): {int.from_bytes(header[49:53], "big")}')
+print(f'Bytes 53-54 (cart type): 0x{cart_type:04X}')
+print(f'Bytes 55-56 (controllers): 0x{header[55]:02X} 0x{header[56]:02X}')
+print(f'Byte 57 (TV type): 0x{header[57]:02X} ({"PAL" if header[57] & 1 else "NTSC"})')
+print(f'Byte 58 (save device): 0x{header[58]:02X}')
 print()
 
 print('Bytes 100-116 (cart name):')
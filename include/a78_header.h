@@ -0,0 +1,163 @@
+#ifndef A78_HEADER_H
+#define A78_HEADER_H
+
+#include <stdint.h>
+#include <string.h>
+
+// .a78 header decode, shared by the firmware (built-in image and
+// -DROM_FROM_SD) and tools/bus_sim. Everything boot needs from a header
+// lands in one CartConfig: the mapper (which bus loop and page table,
+// mappers.h), where POKEY sits, and the TV and save-device bytes.
+//
+// Header fields used (v3 layout; v4 headers repeat them):
+//    1-9    "ATARI7800"
+//   49-52   ROM size after the header, big-endian
+//   53-54   cart type word (CART_TYPE_* below; banked and mirrored RAM
+//           are rejected as A78_UNSUPPORTED)
+//   57      TV type: bit 0 PAL
+//   58      save device: bit 0 high score cart
+
+#define A78_HEADER_SIZE 128
+
+// Largest ROM any cart type can map: 32 SuperGame banks of 16K.
+#define A78_ROM_SIZE_MAX (512u * 1024)
+
+// Cart type word (byte 53 high, byte 54 low).
+#define CART_TYPE_POKEY_4000 0x0001
+#define CART_TYPE_SUPERGAME  0x0002
+#define CART_TYPE_RAM        0x0004   // 16K RAM at $4000
+#define CART_TYPE_ROM_4000   0x0008   // SuperGame: an extra first bank at $4000
+#define CART_TYPE_BANK6_4000 0x0010   // SuperGame: bank 6 at $4000
+#define CART_TYPE_BANKED_RAM 0x0020   // 32K RAM banked at $4000 (not served)
+#define CART_TYPE_POKEY_450  0x0040
+#define CART_TYPE_MIRROR_RAM 0x0080   // RAM mirrored at $4000 (not served)
+#define CART_TYPE_ACTIVISION 0x0100
+#define CART_TYPE_ABSOLUTE   0x0200
+#define CART_TYPE_POKEY_440  0x0400
+#define CART_TYPE_SOUPER     0x1000
+#define CART_TYPE_POKEY_800  0x8000
+
+enum A78Status {
+    A78_OK = 0,
+    A78_NO_FILE,      // Not opened by the caller (sd_rom.h)
+    A78_BAD_HEADER,   // No "ATARI7800" signature, or a zero ROM size
+    A78_TOO_LARGE,    // ROM size over A78_ROM_SIZE_MAX: no cart is that big
+    A78_SHORT_READ,   // Image ends before the size in its header
+    A78_OVER_LIMIT,   // A real cart size, but over the caller's buffer
+    A78_UNSUPPORTED   // Cart type bits the firmware cannot serve
+};
+
+inline const char *a78StatusName(A78Status status) {
+    switch (status) {
+    case A78_OK:          return "ok";
+    case A78_NO_FILE:     return "no file";
+    case A78_BAD_HEADER:  return "bad header";
+    case A78_TOO_LARGE:   return "too large";
+    case A78_OVER_LIMIT:  return "over build limit";
+    case A78_UNSUPPORTED: return "unsupported cart";
+    default:              return "short read";
+    }
+}
+
+enum CartMapper {
+    MAPPER_FLAT = 0,
+    MAPPER_SUPERGAME,
+    MAPPER_ABSOLUTE,
+    MAPPER_ACTIVISION,
+    MAPPER_FLAT_RAM,
+    MAPPER_SUPERGAME_RAM
+};
+
+inline const char *cartMapperName(CartMapper mapper) {
+    switch (mapper) {
+    case MAPPER_SUPERGAME:     return "supergame";
+    case MAPPER_ABSOLUTE:      return "absolute";
+    case MAPPER_ACTIVISION:    return "activision";
+    case MAPPER_FLAT_RAM:      return "flat-ram";
+    case MAPPER_SUPERGAME_RAM: return "supergame-ram";
+    default:                   return "flat";
+    }
+}
+
+// Souper carts (CHR banking over cart RAM) are not served yet and fall back
+// to the flat layout. Cart RAM is only served with the flat and SuperGame
+// layouts; Absolute and Activision carts have ROM at $4000.
+inline CartMapper cartMapperFor(uint16_t cartType) {
+    bool ram = (cartType & CART_TYPE_RAM) != 0;
+    if (cartType & CART_TYPE_ACTIVISION) return MAPPER_ACTIVISION;
+    if (cartType & CART_TYPE_ABSOLUTE) return MAPPER_ABSOLUTE;
+    if (cartType & CART_TYPE_SUPERGAME) return ram ? MAPPER_SUPERGAME_RAM : MAPPER_SUPERGAME;
+    return ram ? MAPPER_FLAT_RAM : MAPPER_FLAT;
+}
+
+// What a SuperGame cart shows at $4000-$7FFF when it has no RAM there.
+enum CartRom4000 {
+    ROM_4000_SECOND_LAST = 0,  // The second-to-last bank
+    ROM_4000_FIRST,            // The image's first bank; the window runs over the rest
+    ROM_4000_BANK6             // Bank 6
+};
+
+// 144K SuperGame images carry the extra bank of bit 3 whether or not their
+// header sets it. Flat carts ignore bits 3 and 4: 48K already reaches $4000.
+inline CartRom4000 cartRom4000For(uint16_t cartType, uint32_t romSize) {
+    if (!(cartType & CART_TYPE_SUPERGAME)) return ROM_4000_SECOND_LAST;
+    if (cartType & CART_TYPE_ROM_4000) return ROM_4000_FIRST;
+    if (cartType & CART_TYPE_BANK6_4000) return ROM_4000_BANK6;
+    if (romSize == 9u << 14) return ROM_4000_FIRST;
+    return ROM_4000_SECOND_LAST;
+}
+
+// POKEY base address for the cart type, 0 for none. $440 comes first so a
+// dual-POKEY cart ($440 and $450) gets $440 and the -DPOKEY_STEREO build
+// finds the second chip 16 bytes up.
+inline uint16_t cartPokeyAddrFor(uint16_t cartType) {
+    if (cartType & CART_TYPE_POKEY_440) return 0x0440;
+    if (cartType & CART_TYPE_POKEY_450) return 0x0450;
+    if (cartType & CART_TYPE_POKEY_800) return 0x0800;
+    if (cartType & CART_TYPE_POKEY_4000) return 0x4000;
+    return 0;
+}
+
+struct CartConfig {
+    uint32_t    romSize;    // Bytes after the header
+    uint16_t    cartType;
+    CartMapper  mapper;     // Bus loop and page table (mappers.h)
+    CartRom4000 rom4000;    // SuperGame ROM at $4000
+    uint16_t    pokeyAddr;  // POKEY base, 0: none
+    bool        pal;
+    bool        hsc;        // Wants a high score cart (not served yet)
+};
+
+// Config from a bare cart type word, for images without a header.
+inline CartConfig cartConfigFor(uint16_t cartType, uint32_t romSize) {
+    CartConfig config;
+    config.romSize = romSize;
+    config.cartType = cartType;
+    config.mapper = cartMapperFor(cartType);
+    config.rom4000 = cartRom4000For(cartType, romSize);
+    config.pokeyAddr = cartPokeyAddrFor(cartType);
+    config.pal = false;
+    config.hsc = false;
+    return config;
+}
+
+inline A78Status parseA78Header(const uint8_t *header, CartConfig &config) {
+    if (memcmp(header + 1, "ATARI7800", 9) != 0) return A78_BAD_HEADER;
+    uint32_t size = ((uint32_t)header[49] << 24) | ((uint32_t)header[50] << 16)
+                  | ((uint32_t)header[51] << 8) | header[52];
+    if (size == 0) return A78_BAD_HEADER;
+
+    uint16_t cartType = (uint16_t)((header[53] << 8) | header[54]);
+    config = cartConfigFor(cartType, size);
+    if (cartType & (CART_TYPE_BANKED_RAM | CART_TYPE_MIRROR_RAM)) return A78_UNSUPPORTED;
+    // $4000 is RAM or ROM, not both; bank 6 needs seven banks.
+    if (config.mapper == MAPPER_SUPERGAME_RAM && (cartType & (CART_TYPE_ROM_4000 | CART_TYPE_BANK6_4000))) {
+        return A78_UNSUPPORTED;
+    }
+    if (config.rom4000 == ROM_4000_BANK6 && size < 7u << 14) return A78_UNSUPPORTED;
+    config.pal = (header[57] & 1) != 0;
+    config.hsc = (header[58] & 1) != 0;
+    return A78_OK;
+}
+
+#endif // A78_HEADER_H
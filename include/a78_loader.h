@@ -0,0 +1,47 @@
+#ifndef A78_LOADER_H
+#define A78_LOADER_H
+
+#include <stddef.h>
+#include "a78_header.h"
+
+// .a78 image loader, shared by the firmware (-DROM_FROM_SD, sd_rom.h) and
+// tools/bus_sim (--rom, --check-load).
+//
+// Decodes the 128-byte header (a78_header.h), then streams the ROM straight
+// into the caller's buffer in A78_READ_CHUNK pieces: with chunks this large
+// the SD library moves whole sectors into the buffer without an
+// intermediate copy. The source is anything with
+//     size_t read(uint8_t *dst, size_t n)   // fewer than n: end or error
+
+#ifndef A78_READ_CHUNK
+#define A78_READ_CHUNK (16u * 1024)
+#endif
+
+struct A78Image {
+    CartConfig config;   // Decoded header (a78_header.h)
+    uint32_t reads;      // Source reads it took
+};
+
+template <class Source>
+A78Status loadA78(Source &src, uint8_t *rom, uint32_t capacity, A78Image &image) {
+    uint8_t header[A78_HEADER_SIZE];
+    image.config = cartConfigFor(0, 0);
+    image.reads = 1;
+    if (src.read(header, A78_HEADER_SIZE) != A78_HEADER_SIZE) return A78_SHORT_READ;
+    A78Status status = parseA78Header(header, image.config);
+    if (status != A78_OK) return status;
+
+    uint32_t size = image.config.romSize;
+    if (size > A78_ROM_SIZE_MAX) return A78_TOO_LARGE;
+    if (size > capacity) return A78_OVER_LIMIT;
+
+    for (uint32_t offset = 0; offset < size; ) {
+        uint32_t n = size - offset < A78_READ_CHUNK ? size - offset : A78_READ_CHUNK;
+        image.reads++;
+        if (src.read(rom + offset, n) != n) return A78_SHORT_READ;
+        offset += n;
+    }
+    return A78_OK;
+}
+
+#endif // A78_LOADER_H
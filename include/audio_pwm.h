@@ -0,0 +1,43 @@
+#ifndef AUDIO_PWM_H
+#define AUDIO_PWM_H
+
+#include <Arduino.h>
+#include "pokey.h"
+
+// EAUD PWM setup (pin 37, FLEXPWM2 submodule 3, channel B; the stereo
+// right channel on pin 28 is FLEXPWM3 submodule 1, channel B).
+#define AUDIO_PWM_FREQUENCY  375000
+#define AUDIO_PWM_RESOLUTION 8
+
+// Mixing knee: larger is more linear. Real POKEY sums channel currents
+// into a shared load, so loudness compresses as more volume is added.
+#define POKEY_MIX_KNEE 60
+
+// FLEXPWM runs from the IPG bus clock: set_arm_clock() picks the smallest
+// divider that keeps it under 150 MHz, capped at 4 (204 MHz at 816 MHz).
+constexpr uint32_t audioPwmBusHz() {
+    return F_CPU / (((F_CPU + 149999999UL) / 150000000UL) > 4 ? 4 : ((F_CPU + 149999999UL) / 150000000UL));
+}
+
+// Counter period (VAL1 + 1) that analogWriteFrequency() programs.
+constexpr uint32_t AUDIO_PWM_MODULO = (audioPwmBusHz() + AUDIO_PWM_FREQUENCY / 2) / AUDIO_PWM_FREQUENCY;
+
+// Maps the summed channel volume (0..60) straight to the SM3VAL5 compare
+// value: the nonlinear POKEY curve in analogWrite() units, converted to
+// counts the same way flexpwmWrite() does.
+struct PokeyPwmTable {
+    uint16_t value[Pokey::MAX_OUTPUT + 1];
+
+    constexpr PokeyPwmTable() : value() {
+        for (uint32_t n = 0; n <= Pokey::MAX_OUTPUT; n++) {
+            uint32_t full = (1UL << AUDIO_PWM_RESOLUTION) - 1;
+            uint32_t level = (full * n * (Pokey::MAX_OUTPUT + POKEY_MIX_KNEE))
+                           / (Pokey::MAX_OUTPUT * (n + POKEY_MIX_KNEE));
+            value[n] = (uint16_t)((level * AUDIO_PWM_MODULO) >> AUDIO_PWM_RESOLUTION);
+        }
+    }
+};
+
+constexpr PokeyPwmTable POKEY_PWM_TABLE{};
+
+#endif // AUDIO_PWM_H
@@ -0,0 +1,716 @@
+#ifndef BUS_ENGINE_H
+#define BUS_ENGINE_H
+
+// The bus engine: address decode, ROM/POKEY drive, write sniffing and the
+// distributed POKEY clock. Every function touching hardware is templated on
+// a HAL policy (bus_hal.h): loop() instantiates it on TeensyBusHal,
+// tools/bus_sim on HostBusHal. The bus loops are further templated on the
+// cartridge mapper (mappers.h).
+// Included from exactly one translation unit (it defines the engine state).
+
+#include <string.h>
+
+#include "bus_hal.h"
+#include "game_rom.h"
+#include "page_table.h"
+#include "mappers.h"
+#include "a78_header.h"
+
+// --- POKEY EMULATION ---
+#include "PokeyWrapper.h"
+#include "audio_pwm.h"
+PokeyWrapper pokey;
+
+// Calibrated for current correct pitch at 816MHz (9 x 1417 per sample).
+#define CYCLES_PER_SAMPLE 12753
+#define CYCLES_PER_STEP (CYCLES_PER_SAMPLE / PokeyWrapper::STEPS_PER_SAMPLE)
+
+// POKEY sits where the cart header says (cartConfig.pokeyAddr); images
+// converted without their header keep it at POKEY_BASE_ADDR.
+#define POKEY_BASE_ADDR 0x0450
+
+// Build with -DPOKEY_STEREO for a second POKEY 16 bytes above the first
+// (right channel on pin 28); both chips are stepped together by DualPokey.
+#ifdef POKEY_STEREO
+#define IS_POKEY_ADDR(a, base) ((uint16_t)((a) - (base)) < 0x20)
+#else
+#define IS_POKEY_ADDR(a, base) (((a) & 0xFFF0) == (base))
+#endif
+uint32_t lastPokeyCycle = 0;
+uint32_t pokeyDebt = 0;
+
+// --- CARTRIDGE IMAGE ---
+// What busEngineBegin() maps: the built-in game_rom.h image unless the
+// caller points these elsewhere first (sd_rom.h, tools/bus_sim --rom).
+// cartConfig is its decoded .a78 header (a78_header.h) and picks the
+// mapper and the POKEY address. game_rom.h carries the header as
+// ROM_HEADER (convert_rom.py); older conversions without it give CART_TYPE,
+// the bare cart type word, instead.
+#ifndef CART_TYPE
+#define CART_TYPE 0
+#endif
+const uint8_t *cartRom = ROM_DATA;
+uint32_t cartRomSize = sizeof(ROM_DATA);
+
+inline CartConfig builtInCartConfig() {
+    CartConfig config;
+#ifdef ROM_HAS_HEADER
+    if (parseA78Header(ROM_HEADER, config) == A78_OK) return config;
+#endif
+    config = cartConfigFor(CART_TYPE, sizeof(ROM_DATA));
+    if (!config.pokeyAddr) config.pokeyAddr = POKEY_BASE_ADDR;
+    return config;
+}
+CartConfig cartConfig = builtInCartConfig();
+
+// --- PRE-SHIFTED ROM (build with -DROM_WORD_IMAGE) ---
+// Each ROM byte stored as the full GPIO6_DR word that drives it, so the
+// cartridge branch is one load and one store. Costs 4x the ROM in RAM
+// (192 KB for 48K), built once at boot.
+#ifdef ROM_WORD_IMAGE
+#ifndef ROM_WORDS_MAX
+#define ROM_WORDS_MAX sizeof(ROM_DATA)
+#endif
+static_assert(ROM_WORDS_MAX >= sizeof(ROM_DATA), "ROM_WORDS_MAX must cover the built-in image");
+uint32_t ROM_WORDS[ROM_WORDS_MAX];
+
+// cartRomSize never exceeds ROM_WORDS_MAX: the built-in image is checked
+// above and -DROM_FROM_SD rejects larger images as over the limit (sd_rom.h).
+template <class Hal>
+void buildRomWords() {
+    uint32_t base = Hal::dataBase();
+    for (uint32_t i = 0; i < cartRomSize; i++) {
+        ROM_WORDS[i] = base | ((uint32_t)cartRom[i] << 16);
+    }
+}
+#endif
+
+// --- ADDRESS DISPATCH (see page_table.h) ---
+PageEntry PAGE_TABLE[256];
+BankWindow cartBank;
+CartMapper cartMapper = MAPPER_FLAT;
+
+// --- CARTRIDGE RAM ($4000-$7FFF, cart type bit 2) ---
+// An ordinary global, which the Teensy 4 linker places in DTCM: one-cycle
+// loads and stores from the bus loop. Cleared at boot.
+uint8_t cartRam[0x4000];
+
+// --- BOOT TIMING ---
+// DWT stamps, counted from reset (the Teensy startup code starts the
+// counter): setup() entry, SD card ready (-DROM_FROM_SD), cart image in
+// place and the engine ready, after which the bus loop serves the first
+// fetch. USB is not up that early, so -DBUS_STATS prints them, with the
+// cart config, at the top of each report instead.
+struct BootTiming {
+    uint32_t setup;
+    uint32_t sdReady;
+    uint32_t loaded;
+    uint32_t ready;
+    uint32_t romBytes;   // Read from SD (0: built-in image)
+    uint32_t reads;      // SD reads it took
+    const char *sdError; // Why the SD image was not used, or NULL
+    uint32_t sdRomSize;  // Over the limit: the image's ROM size
+    uint32_t sdLimit;    //   and the most this build holds
+
+    void print() const {
+        uint32_t perUs = F_CPU / 1000000;
+        BusHal::logPrintf("# boot: setup at %lu us, serving at %lu us (%s%s%s)\n",
+                          (unsigned long)(setup / perUs), (unsigned long)(ready / perUs),
+                          romBytes ? "SD image" : "built-in image",
+                          sdError ? ", SD: " : "", sdError ? sdError : "");
+        BusHal::logPrintf("# boot: cart type 0x%04X (%s), POKEY at $%04X, %s%s\n",
+                          cartConfig.cartType, cartMapperName(cartMapper), cartConfig.pokeyAddr,
+                          cartConfig.pal ? "PAL" : "NTSC", cartConfig.hsc ? ", HSC" : "");
+        if (sdLimit) {
+            BusHal::logPrintf("# boot: SD image is %lu bytes, this build holds %lu (SD_ROM_MAX, ROM_WORDS_MAX)\n",
+                              (unsigned long)sdRomSize, (unsigned long)sdLimit);
+        }
+        if (romBytes) {
+            uint32_t us = (loaded - sdReady) / perUs;
+            BusHal::logPrintf("# boot: card ready in %lu us, %lu bytes in %lu reads, %lu us (%lu KB/s)\n",
+                              (unsigned long)((sdReady - setup) / perUs), (unsigned long)romBytes,
+                              (unsigned long)reads, (unsigned long)us,
+                              (unsigned long)(us ? (uint64_t)romBytes * 1000 / 1024 / us : 0));
+        }
+    }
+};
+BootTiming bootTiming;
+
+// --- BUS TRACE (build with -DBUS_TRACE, see bus_trace.h) ---
+#ifdef BUS_TRACE
+#include "bus_trace.h"
+BusTrace busTrace;
+#endif
+
+// --- LATENCY HISTOGRAMS (build with -DBUS_STATS, see bus_stats.h) ---
+#ifdef BUS_STATS
+#include "bus_stats.h"
+BusStats busStats;
+#endif
+
+// Lay the image out for `Mapper`, or flat if it is too small for it.
+template <class Mapper>
+void mapCart(CartMapper kind, const RomCell *image) {
+    if (cartRomSize < Mapper::MIN_ROM) {
+        kind = MAPPER_FLAT;
+        FlatMapper::begin(PAGE_TABLE, image, cartRomSize, cartConfig);
+    } else {
+        Mapper::begin(PAGE_TABLE, image, cartRomSize, cartConfig);
+    }
+    cartMapper = kind;
+}
+
+// Engine state for a fresh bus; the caller has already put the data bus in
+// LISTEN and released the IRQ line.
+template <class Hal>
+void busEngineBegin() {
+#ifdef ROM_WORD_IMAGE
+    buildRomWords<Hal>();
+    const RomCell *image = ROM_WORDS;
+#else
+    const RomCell *image = cartRom;
+#endif
+    switch (cartConfig.mapper) {
+    case MAPPER_SUPERGAME:  mapCart<SuperGameMapper>(MAPPER_SUPERGAME, image); break;
+    case MAPPER_ABSOLUTE:   mapCart<AbsoluteMapper>(MAPPER_ABSOLUTE, image); break;
+    case MAPPER_ACTIVISION: mapCart<ActivisionMapper>(MAPPER_ACTIVISION, image); break;
+    case MAPPER_FLAT_RAM:   mapCart<CartRamMapper<FlatMapper> >(MAPPER_FLAT_RAM, image); break;
+    case MAPPER_SUPERGAME_RAM:
+        mapCart<CartRamMapper<SuperGameMapper> >(MAPPER_SUPERGAME_RAM, image);
+        break;
+    default:                mapCart<FlatMapper>(MAPPER_FLAT, image); break;
+    }
+    memset(cartRam, 0, sizeof(cartRam));
+    lastPokeyCycle = Hal::cycles();
+    pokey.begin(lastPokeyCycle, CYCLES_PER_SAMPLE);
+    bootTiming.ready = lastPokeyCycle;
+
+#if defined(BUS_TRACE) || defined(BUS_STATS)
+    Hal::logInit();
+#endif
+#ifdef BUS_TRACE
+    busTrace.reset();
+#endif
+#ifdef BUS_STATS
+    busStats.reset(Hal::cycles());
+#endif
+}
+
+template <class Hal> __attribute__((always_inline))
+inline uint16_t readFull16BitAddress() {
+    uint32_t g6 = Hal::gpio6();
+    uint32_t g7 = Hal::gpio7();
+
+    uint16_t high = (g6 >> 16) & 0xFF00;
+    uint16_t low = (g7 & 0x0F) | ((g7 >> 6) & 0x70) | ((g7 >> 9) & 0x80);
+
+    return high|low;
+}
+
+// Put one byte on the data bus; the direction flip only on the first drive.
+template <class Hal> __attribute__((always_inline))
+inline void driveByte(uint8_t data, bool &isDriving) {
+    if (!isDriving) {
+        Hal::drive(data);
+        isDriving = true;
+    } else {
+        Hal::writeData(data);
+    }
+}
+
+// Drive one ROM cell (a byte, or a GPIO6 word with -DROM_WORD_IMAGE).
+template <class Hal> __attribute__((always_inline))
+inline void driveCell(RomCell cell, bool &isDriving) {
+#ifdef ROM_WORD_IMAGE
+    if (!isDriving) {
+        Hal::driveWord(cell);
+        isDriving = true;
+    } else {
+        Hal::writeWord(cell);
+    }
+#else
+    driveByte<Hal>(cell, isDriving);
+#endif
+}
+
+// Drive the ROM cell behind `addr` in a PAGE_ROM or PAGE_SWITCH page.
+template <class Hal> __attribute__((always_inline))
+inline void driveRom(const PageEntry &page, uint16_t addr, bool &isDriving) {
+    driveCell<Hal>(page.base[addr & 0xFF], isDriving);
+}
+
+// --- SEQUENTIAL PREDICTION (build with -DBUS_PREDICT) ---
+// Opcode fetches and MARIA graphics reads mostly walk upwards, so after
+// serving a ROM address the next cell is loaded ahead of time. When the
+// bus moves to addr + 1 the byte goes out after a single compare, with no
+// page lookup or ROM load in between.
+struct SeqPredictor {
+    uint32_t addr;   // Address the cell belongs to; 0x10000 never matches
+    RomCell  cell;
+
+    void reset() {
+        addr = 0x10000;
+        cell = 0;
+    }
+
+    // After serving ROM at `from` (cheap when already predicted).
+    __attribute__((always_inline)) inline void update(uint16_t from) {
+        uint32_t next = (uint32_t)from + 1;
+        if (next == addr) return;
+        const PageEntry &page = PAGE_TABLE[(next >> 8) & 0xFF];
+        if (next <= 0xFFFF && page.kind == PAGE_ROM) {
+            cell = page.base[next & 0xFF];
+            addr = next;
+        } else {
+            addr = 0x10000;
+        }
+    }
+};
+
+// Hand the staged POKEY write on. IRQ registers act in bus time (an IRQEN
+// ack must drop the line before RTI), the rest goes through the queue.
+template <class Hal> __attribute__((always_inline))
+inline void commitPokeyWrite(PokeyWriteQueue &queue, uint32_t &irqCycle) {
+    const PokeyWrite &w = queue.staged();
+    Hal::pokeyWriteHook(w.cycle, w.reg, w.value);
+    pokey.noteWrite(w.cycle, w.reg, w.value);
+    irqCycle = pokey.nextIrqCycle();
+    Hal::irq(pokey.irqAsserted());
+    queue.commit();
+}
+
+// --- MARIA DMA LOOP (HALT low) ---
+// While MARIA fetches, serving ROM is the whole job: the ROM path reads only
+// the address, and HALT is checked only when a non-ROM address turns up
+// (MARIA reading RAM, or the CPU back on the bus touching RAM/POKEY or
+// writing to the mapper). The CPU loop then takes over on the very next
+// pass, with that address still on the bus.
+template <class Hal, class Mapper> __attribute__((always_inline))
+inline void busEngineDma(bool &isDriving, SeqPredictor &predict) {
+#ifndef BUS_PREDICT
+    (void)predict;
+#endif
+    while (Hal::running()) {
+        uint16_t addr = readFull16BitAddress<Hal>();
+#ifdef BUS_TRACE
+        busTrace.capture(addr, Hal::RW_BIT); // MARIA only reads
+#endif
+#ifdef BUS_STATS
+        busStats.top(addr);
+#endif
+
+#ifdef BUS_PREDICT
+        if (addr == predict.addr) {
+            driveCell<Hal>(predict.cell, isDriving);
+#ifdef BUS_STATS
+            busStats.drivenPredicted();
+#endif
+            predict.update(addr);
+            continue;
+        }
+#endif
+
+        const PageEntry &page = PAGE_TABLE[addr >> 8];
+        if (page.kind == PAGE_ROM) {
+            driveRom<Hal>(page, addr, isDriving);
+#ifdef BUS_STATS
+            busStats.drivenDma();
+#endif
+#ifdef BUS_PREDICT
+            predict.update(addr);
+#endif
+        } else if (Mapper::SWITCHED && page.kind == PAGE_BANK && (Hal::gpio9() & Hal::RW_BIT)) {
+            // MARIA only reads; a write here is the CPU back, switching banks.
+            driveCell<Hal>(Mapper::bankCell(addr), isDriving);
+#ifdef BUS_STATS
+            busStats.drivenDma();
+#endif
+        } else if (Mapper::SWITCHED && page.kind == PAGE_SWITCH && (Hal::gpio9() & Hal::RW_BIT)) {
+            driveRom<Hal>(page, addr, isDriving);
+#ifdef BUS_STATS
+            busStats.drivenDma();
+#endif
+        } else if (Mapper::CART_RAM && page.kind == PAGE_CART_RAM && (Hal::gpio9() & Hal::RW_BIT)) {
+            // Graphics kept in cart RAM.
+            driveByte<Hal>(cartRam[addr & 0x3FFF], isDriving);
+#ifdef BUS_STATS
+            busStats.drivenRam();
+#endif
+        } else {
+            if (isDriving) {
+                Hal::listen();
+                isDriving = false;
+            }
+            if (Hal::gpio9() & Hal::HALT_BIT) return;
+        }
+    }
+}
+
+// Serves the bus until Hal::running() goes false (never, on the target).
+template <class Hal, class Mapper> __attribute__((always_inline))
+inline void busEngineRun() {
+    uint16_t addr;
+    bool isDriving = false;
+    SeqPredictor predict;
+    predict.reset();
+
+    PokeyWriteQueue &pokeyQueue = pokey.writeQueue();
+    const uint8_t *pokeyReadRegs = pokey.readRegisters();
+    const uint16_t pokeyBase = cartConfig.pokeyAddr;
+    uint32_t pokeyIrqCycle = pokey.nextIrqCycle();
+
+    while (Hal::running()) {
+        // --- 1. PRISTINE LOOP HEADER (The Graphics Fix) ---
+        // Absolutely NO logic before this. Address read is the #1 priority.
+        addr = readFull16BitAddress<Hal>();
+#ifdef BUS_TRACE
+        busTrace.capture(addr, Hal::gpio9());
+#endif
+#ifdef BUS_STATS
+        busStats.top(addr);
+#endif
+
+#ifdef BUS_PREDICT
+        // --- SEQUENTIAL HIT (cell loaded on the previous ROM pass) ---
+        if (addr == predict.addr) {
+            driveCell<Hal>(predict.cell, isDriving);
+#ifdef BUS_STATS
+            busStats.drivenPredicted();
+#endif
+            predict.update(addr);
+            if (pokeyQueue.isStaged()) commitPokeyWrite<Hal>(pokeyQueue, pokeyIrqCycle);
+            continue;
+        }
+#endif
+
+        const PageEntry &page = PAGE_TABLE[addr >> 8];
+        bool pokeyWrite = false;  // This pass saw a POKEY write on the bus
+
+        // --- CARTRIDGE BRANCH (Drive ROM Data) ---
+        if (page.kind == PAGE_ROM) {
+            driveRom<Hal>(page, addr, isDriving);
+#ifdef BUS_STATS
+            busStats.driven();
+#endif
+#ifdef BUS_PREDICT
+            predict.update(addr);
+#endif
+        }
+        // --- BANKED WINDOW / SWITCH PAGE READ (writes go to the mapper) ---
+        // Compiled out for unbanked carts (Mapper::SWITCHED false).
+        else if (Mapper::SWITCHED && page.kind == PAGE_BANK && (Hal::gpio9() & Hal::RW_BIT)) {
+            driveCell<Hal>(Mapper::bankCell(addr), isDriving);
+#ifdef BUS_STATS
+            busStats.driven();
+#endif
+        }
+        else if (Mapper::SWITCHED && page.kind == PAGE_SWITCH && (Hal::gpio9() & Hal::RW_BIT)) {
+            driveRom<Hal>(page, addr, isDriving);
+#ifdef BUS_STATS
+            busStats.driven();
+#endif
+        }
+        // --- CART RAM READ ($4000-$7FFF; writes are latched in the listen branch) ---
+        else if (Mapper::CART_RAM && page.kind == PAGE_CART_RAM && (Hal::gpio9() & Hal::RW_BIT)) {
+            driveByte<Hal>(cartRam[addr & 0x3FFF], isDriving);
+#ifdef BUS_STATS
+            busStats.drivenRam();
+#endif
+        }
+        // --- POKEY READ BRANCH (RANDOM, IRQST, ...) ---
+        // Pin 3 (R/W) HIGH = Read. The byte is precomputed: one load, then drive.
+        else if (page.kind == PAGE_POKEY && IS_POKEY_ADDR(addr, pokeyBase) && (Hal::gpio9() & Hal::RW_BIT)) {
+            driveByte<Hal>(pokeyReadRegs[(addr - pokeyBase) & PokeyWrapper::REG_MASK], isDriving);
+#ifdef BUS_STATS
+            busStats.driven();
+#endif
+        }
+        // --- LISTEN / SAFE BRANCH ($0000-3FFF) ---
+        else {
+            if (isDriving) {
+                Hal::listen();
+                isDriving = false;
+            }
+
+            // Gated by HALT (Pin 5 / GPIO9 bit 8). HIGH = CPU Active.
+            // HALT low: MARIA owns the bus, hand over to the DMA loop.
+            if (!(Hal::gpio9() & Hal::HALT_BIT)) {
+                busEngineDma<Hal, Mapper>(isDriving, predict);
+            } else {
+
+                // --- CLOCK RECOVERY (Stall-Free) ---
+                // We track time ONLY in the LISTEN branch.
+                // Replace while with if to ensure we NEVER stall the bus for >50ns.
+                uint32_t currentCycle = Hal::cycles();
+                if ((currentCycle - lastPokeyCycle) >= CYCLES_PER_STEP) {
+                    pokeyDebt++;
+                    lastPokeyCycle += CYCLES_PER_STEP;
+                }
+                if (pokeyDebt > 2000) pokeyDebt = 2000;
+
+                // --- TIMER IRQ (one compare; the schedule is precomputed) ---
+                if ((int32_t)(currentCycle - pokeyIrqCycle) >= 0) {
+                    pokeyIrqCycle = pokey.serviceIrq(currentCycle);
+                    Hal::irq(pokey.irqAsserted());
+                }
+
+                // --- POKEY SNIFFER ---
+                // Stage the write while it is on the bus (data settles late);
+                // it is committed below once the address moves on. Reads were
+                // served above, so R/W is LOW here. A sample is qualified like
+                // the mapper write: PHI2 high before and after, A8-A15 still
+                // on the POKEY page.
+                if (page.kind == PAGE_POKEY && IS_POKEY_ADDR(addr, pokeyBase)) {
+                    pokeyWrite = true;
+                    if ((Hal::gpio9() & (Hal::PHI2_BIT | Hal::RW_BIT)) == Hal::PHI2_BIT) {
+                        uint32_t g6 = Hal::gpio6();
+                        if ((g6 >> 24) == (uint32_t)(addr >> 8)
+                            && (Hal::gpio9() & (Hal::PHI2_BIT | Hal::RW_BIT)) == Hal::PHI2_BIT) {
+                            pokeyQueue.stage(currentCycle, (addr - pokeyBase) & PokeyWrapper::REG_MASK,
+                                             (g6 >> 16) & 0xFF);
+                        }
+                    }
+                }
+
+                // --- MAPPER WRITE (CPU write to a PAGE_BANK/PAGE_SWITCH page) ---
+                // Re-latched on every pass while the write is on the bus, so
+                // the settled data byte wins. A sample only counts if it was
+                // taken inside PHI2 high of a write (checked before and
+                // after) with A8-A15 in the same GPIO6 read still on the
+                // same page: earlier the data is not valid yet, later it may
+                // be the next cycle's bus. The predictor never loads from
+                // either kind of page, so a switch leaves nothing stale.
+                if (Mapper::SWITCHED && (page.kind == PAGE_BANK || page.kind == PAGE_SWITCH)
+                    && (Hal::gpio9() & (Hal::PHI2_BIT | Hal::RW_BIT)) == Hal::PHI2_BIT) {
+                    uint32_t g6 = Hal::gpio6();
+                    if ((g6 >> 24) == (uint32_t)(addr >> 8)
+                        && (Hal::gpio9() & (Hal::PHI2_BIT | Hal::RW_BIT)) == Hal::PHI2_BIT) {
+                        Mapper::write(addr, (g6 >> 16) & 0xFF);
+                    }
+                }
+
+                // --- CART RAM WRITE ---
+                // Same qualification as the mapper write: the last sample
+                // taken inside PHI2 high is the byte that stays.
+                if (Mapper::CART_RAM && page.kind == PAGE_CART_RAM
+                    && (Hal::gpio9() & (Hal::PHI2_BIT | Hal::RW_BIT)) == Hal::PHI2_BIT) {
+                    uint32_t g6 = Hal::gpio6();
+                    if ((g6 >> 24) == (uint32_t)(addr >> 8)
+                        && (Hal::gpio9() & (Hal::PHI2_BIT | Hal::RW_BIT)) == Hal::PHI2_BIT) {
+                        cartRam[addr & 0x3FFF] = (g6 >> 16) & 0xFF;
+                    }
+                }
+
+                // --- DISTRIBUTED MATH (1 step at a time) ---
+                // Queued writes are applied on the step that reaches their timestamp.
+                if (pokeyDebt > 0) {
+                    if (pokey.tickStep(lastPokeyCycle - pokeyDebt * CYCLES_PER_STEP)) {
+                        Hal::audio(POKEY_PWM_TABLE.value[pokey.getOutput()]);
+#ifdef POKEY_STEREO
+                        Hal::audioRight(POKEY_PWM_TABLE.value[pokey.getOutputRight()]);
+#endif
+                    }
+                    pokeyDebt--;
+                }
+#ifdef BUS_STATS
+                busStats.listened();
+#endif
+            }
+        }
+
+        // --- POKEY WRITE COMMIT ---
+        // On the first pass off the write, whichever branch served it: a
+        // write followed only by ROM fetches must not be merged into the next
+        // one. After the drive, so it never delays a byte.
+        if (!pokeyWrite && pokeyQueue.isStaged()) {
+            commitPokeyWrite<Hal>(pokeyQueue, pokeyIrqCycle);
+        }
+    }
+}
+
+// --- PHI2 PHASE-LOCKED MODE (build with -DBUS_PHI2_LOCK) ---
+// Instead of re-reading the address thousands of times per bus cycle, wait
+// for PHI2 to rise (address and R/W are stable by then), decode once and
+// drive, then hold the byte through the falling edge. From PHI2 falling +
+// hold until the next rise nothing on the bus needs us, so clock recovery,
+// IRQ service, write commit and as many synthesis steps as fit run there.
+// Work items are only started inside PHI2_WORK_BUDGET cycles after the
+// fall, so the longest one still ends before the next rise.
+#ifndef PHI2_HOLD_CYCLES
+#define PHI2_HOLD_CYCLES 16     // Data hold after PHI2 falls (~20 ns)
+#endif
+#ifndef PHI2_WORK_BUDGET
+#define PHI2_WORK_BUDGET 140    // Of the ~228-cycle PHI2-low half at 816 MHz
+#endif
+
+template <class Hal, class Mapper> __attribute__((always_inline))
+inline void busEngineRunPhi2() {
+    uint16_t addr;
+    bool isDriving = false;
+    SeqPredictor predict;
+    predict.reset();
+
+    PokeyWriteQueue &pokeyQueue = pokey.writeQueue();
+    const uint8_t *pokeyReadRegs = pokey.readRegisters();
+    const uint16_t pokeyBase = cartConfig.pokeyAddr;
+    uint32_t pokeyIrqCycle = pokey.nextIrqCycle();
+#ifdef BUS_STATS
+    uint32_t workEnd = Hal::cycles();
+#endif
+
+    while (Hal::running()) {
+        // --- 1. WAIT FOR PHI2 HIGH ---
+        uint32_t g9;
+        do {
+            g9 = Hal::gpio9();
+        } while (!(g9 & Hal::PHI2_BIT) && Hal::running());
+
+        addr = readFull16BitAddress<Hal>();
+#ifdef BUS_STATS
+        busStats.freeCycles(Hal::cycles() - workEnd);
+#endif
+#ifdef BUS_TRACE
+        busTrace.capture(addr, g9);
+#endif
+#ifdef BUS_STATS
+        busStats.top(addr);
+#endif
+
+        // --- 2. DRIVE (same decode as the free-running loop) ---
+        const PageEntry &page = PAGE_TABLE[addr >> 8];
+        bool pokeyHit = page.kind == PAGE_POKEY && IS_POKEY_ADDR(addr, pokeyBase);
+        bool sniff = false;
+        bool bankWrite = false;
+        bool ramWrite = false;
+
+#ifdef BUS_PREDICT
+        if (addr == predict.addr) {
+            driveCell<Hal>(predict.cell, isDriving);
+#ifdef BUS_STATS
+            busStats.drivenPredicted();
+#endif
+        } else
+#endif
+        if (page.kind == PAGE_ROM) {
+            driveRom<Hal>(page, addr, isDriving);
+#ifdef BUS_STATS
+            busStats.driven();
+#endif
+        } else if (Mapper::SWITCHED && page.kind == PAGE_BANK && (g9 & Hal::RW_BIT)) {
+            driveCell<Hal>(Mapper::bankCell(addr), isDriving);
+#ifdef BUS_STATS
+            busStats.driven();
+#endif
+        } else if (Mapper::SWITCHED && page.kind == PAGE_SWITCH && (g9 & Hal::RW_BIT)) {
+            driveRom<Hal>(page, addr, isDriving);
+#ifdef BUS_STATS
+            busStats.driven();
+#endif
+        } else if (Mapper::CART_RAM && page.kind == PAGE_CART_RAM && (g9 & Hal::RW_BIT)) {
+            driveByte<Hal>(cartRam[addr & 0x3FFF], isDriving);
+#ifdef BUS_STATS
+            busStats.drivenRam();
+#endif
+        } else if (pokeyHit && (g9 & Hal::RW_BIT)) {
+            driveByte<Hal>(pokeyReadRegs[(addr - pokeyBase) & PokeyWrapper::REG_MASK], isDriving);
+#ifdef BUS_STATS
+            busStats.driven();
+#endif
+        } else {
+            // CPU writes only (HALT high); write data settles late.
+            sniff = pokeyHit && (g9 & Hal::HALT_BIT);
+            bankWrite = Mapper::SWITCHED && (page.kind == PAGE_BANK || page.kind == PAGE_SWITCH)
+                        && (g9 & Hal::HALT_BIT);
+            ramWrite = Mapper::CART_RAM && page.kind == PAGE_CART_RAM && (g9 & Hal::HALT_BIT);
+        }
+
+        // --- 3. HOLD UNTIL PHI2 FALLS (re-sampling write data) ---
+        // A sample only counts if PHI2 was still high after it was taken;
+        // one taken after the fall may already be the next cycle's bus.
+        uint32_t rise = Hal::cycles();
+        for (;;) {
+            uint32_t g6 = (sniff || bankWrite || ramWrite) ? Hal::gpio6() : 0;
+            if (!(Hal::gpio9() & Hal::PHI2_BIT) || !Hal::running()) break;
+            if (sniff) {
+                pokeyQueue.stage(rise, (addr - pokeyBase) & PokeyWrapper::REG_MASK, (g6 >> 16) & 0xFF);
+            }
+            if (bankWrite) {
+                Mapper::write(addr, (g6 >> 16) & 0xFF);
+            }
+            if (ramWrite) {
+                cartRam[addr & 0x3FFF] = (g6 >> 16) & 0xFF;
+            }
+        }
+
+        uint32_t fall = Hal::cycles();
+        while ((Hal::cycles() - fall) < PHI2_HOLD_CYCLES) {}
+        if (isDriving) {
+            Hal::listen();
+            isDriving = false;
+        }
+
+        // --- 4. FREE WINDOW ---
+        if (pokeyQueue.isStaged()) {
+            commitPokeyWrite<Hal>(pokeyQueue, pokeyIrqCycle);
+        }
+
+        uint32_t currentCycle = Hal::cycles();
+        if ((currentCycle - lastPokeyCycle) >= CYCLES_PER_STEP) {
+            pokeyDebt++;
+            lastPokeyCycle += CYCLES_PER_STEP;
+        }
+        if (pokeyDebt > 2000) pokeyDebt = 2000;
+
+        if ((int32_t)(currentCycle - pokeyIrqCycle) >= 0) {
+            pokeyIrqCycle = pokey.serviceIrq(currentCycle);
+            Hal::irq(pokey.irqAsserted());
+        }
+
+#ifdef BUS_PREDICT
+        // Next cycle's cell, loaded while the bus does not need us.
+        if (page.kind == PAGE_ROM) predict.update(addr);
+#endif
+
+        while (pokeyDebt > 0 && (Hal::cycles() - fall) < PHI2_WORK_BUDGET) {
+            if (pokey.tickStep(lastPokeyCycle - pokeyDebt * CYCLES_PER_STEP)) {
+                Hal::audio(POKEY_PWM_TABLE.value[pokey.getOutput()]);
+#ifdef POKEY_STEREO
+                Hal::audioRight(POKEY_PWM_TABLE.value[pokey.getOutputRight()]);
+#endif
+            }
+            pokeyDebt--;
+        }
+#ifdef BUS_STATS
+        busStats.listened();
+        workEnd = Hal::cycles();
+#endif
+    }
+}
+
+// The bus loop this build runs, for one mapper.
+template <class Hal, class Mapper> __attribute__((always_inline))
+inline void busEngineLoop() {
+#ifdef BUS_PHI2_LOCK
+    busEngineRunPhi2<Hal, Mapper>();
+#else
+    busEngineRun<Hal, Mapper>();
+#endif
+}
+
+// Serve the cart busEngineBegin() mapped. Each mapper gets its own fully
+// inlined loop; the switch runs once, as loop() never returns on the target.
+template <class Hal> __attribute__((always_inline))
+inline void busEngineServe() {
+    switch (cartMapper) {
+    case MAPPER_SUPERGAME:  busEngineLoop<Hal, SuperGameMapper>(); break;
+    case MAPPER_ABSOLUTE:   busEngineLoop<Hal, AbsoluteMapper>(); break;
+    case MAPPER_ACTIVISION: busEngineLoop<Hal, ActivisionMapper>(); break;
+    case MAPPER_FLAT_RAM:   busEngineLoop<Hal, CartRamMapper<FlatMapper> >(); break;
+    case MAPPER_SUPERGAME_RAM:
+        busEngineLoop<Hal, CartRamMapper<SuperGameMapper> >();
+        break;
+    default:                busEngineLoop<Hal, FlatMapper>(); break;
+    }
+}
+
+#endif // BUS_ENGINE_H
@@ -0,0 +1,117 @@
+#ifndef BUS_HAL_H
+#define BUS_HAL_H
+
+// Everything the bus engine touches outside the CPU: GPIO, the cycle
+// counter, audio PWM, the IRQ pin and the diagnostic console.
+//
+// The engine is templated on a HAL policy: a struct of static, always-inline
+// accessors and constexpr bit masks. TeensyBusHal is the raw registers, so
+// an engine instantiated on it compiles to the same code as writing the
+// registers inline. HostBusHal (tools/bus_sim/host_gpio.h, -DBUS_SIM) routes
+// the same calls to a model that replays a recorded or synthetic bus.
+// BusHal names the policy this build runs on.
+
+#define HAL_INLINE __attribute__((always_inline)) static inline
+
+#ifdef BUS_SIM
+#include "host_gpio.h"
+typedef HostBusHal BusHal;
+#else
+#include <Arduino.h>
+
+// --- PIN DEFINITIONS ---
+const int PIN_OE   = 2;
+const int PIN_DIR  = 33;
+const int PIN_AUDIO = 37;
+const int PIN_AUDIO_R = 28; // Second POKEY (-DPOKEY_STEREO)
+const int PIN_IRQ   = 36; // Cart IRQ, open drain, LOW = asserted
+
+struct TeensyBusHal {
+    // GPIO6: A8-A15 bits 24-31, D0-D7 bits 16-23.
+    // GPIO7: A0-A3 bits 0-3, A4-A6 bits 10-12, A7 bit 16.
+    // GPIO9: R/W bit 5 (HIGH = read), PHI2 bit 6, DIR bit 7, HALT bit 8
+    //        (HIGH = CPU active).
+    static constexpr uint32_t DATA_BUS_MASK = 0xFFu << 16;
+    static constexpr uint32_t RW_BIT   = 1u << 5;
+    static constexpr uint32_t PHI2_BIT = 1u << 6;
+    static constexpr uint32_t DIR_BIT  = 1u << 7;
+    static constexpr uint32_t HALT_BIT = 1u << 8;
+
+    // --- Inputs ---
+    HAL_INLINE uint32_t gpio6() { return GPIO6_PSR; }
+    HAL_INLINE uint32_t gpio7() { return GPIO7_PSR; }
+    HAL_INLINE uint32_t gpio9() { return GPIO9_PSR; }
+    HAL_INLINE uint32_t cycles() { return ARM_DWT_CYCCNT; }
+
+    // --- Data bus direction ---
+    HAL_INLINE void listen() {
+        GPIO6_GDIR &= ~DATA_BUS_MASK;
+        asm volatile ("dsb" ::: "memory");
+        GPIO9_DR &= ~DIR_BIT;
+        asm volatile ("dsb" ::: "memory");
+    }
+
+    HAL_INLINE void drive(uint8_t data) {
+        GPIO6_DR = (GPIO6_DR & ~DATA_BUS_MASK) | ((uint32_t)data << 16);
+        GPIO9_DR |= DIR_BIT;
+        asm volatile ("dsb" ::: "memory");
+        GPIO6_GDIR |= DATA_BUS_MASK;
+        asm volatile ("dsb" ::: "memory");
+    }
+
+    // New byte while already driving (direction unchanged).
+    HAL_INLINE void writeData(uint8_t data) {
+        GPIO6_DR = (GPIO6_DR & ~DATA_BUS_MASK) | ((uint32_t)data << 16);
+    }
+
+    // Same, from a word already laid out as GPIO6_DR (-DROM_WORD_IMAGE): one
+    // store, no read-modify-write. The non-data bits come from dataBase()
+    // at boot; GPIO6 has no other outputs, so they never go stale.
+    HAL_INLINE uint32_t dataBase() { return GPIO6_DR & ~DATA_BUS_MASK; }
+
+    HAL_INLINE void driveWord(uint32_t word) {
+        GPIO6_DR = word;
+        GPIO9_DR |= DIR_BIT;
+        asm volatile ("dsb" ::: "memory");
+        GPIO6_GDIR |= DATA_BUS_MASK;
+        asm volatile ("dsb" ::: "memory");
+    }
+
+    HAL_INLINE void writeWord(uint32_t word) { GPIO6_DR = word; }
+
+    // --- Outputs ---
+    HAL_INLINE void audio(uint32_t value) {
+        FLEXPWM2_SM3VAL5 = value;
+        FLEXPWM2_MCTRL |= FLEXPWM_MCTRL_LDOK(1<<3);
+    }
+
+    HAL_INLINE void audioRight(uint32_t value) {
+        FLEXPWM3_SM1VAL5 = value;
+        FLEXPWM3_MCTRL |= FLEXPWM_MCTRL_LDOK(1<<1);
+    }
+
+    HAL_INLINE void irq(bool asserted) { digitalWriteFast(PIN_IRQ, asserted ? LOW : HIGH); }
+
+    // Observation hook for committed POKEY writes (the simulator logs them).
+    HAL_INLINE void pokeyWriteHook(uint32_t, uint8_t, uint8_t) {}
+
+    // The bus loop never returns on the target.
+    HAL_INLINE constexpr bool running() { return true; }
+
+    // --- Diagnostic console (BUS_TRACE, BUS_STATS) ---
+    // USB Serial needs interrupts; the bus is not served while it prints.
+    static void logInit() { Serial.begin(115200); }
+    static void logBegin() { interrupts(); }
+    static void logEnd() {
+        Serial.flush();
+        noInterrupts();
+    }
+
+    template <typename... Args>
+    static void logPrintf(const char *format, Args... args) { Serial.printf(format, args...); }
+};
+
+typedef TeensyBusHal BusHal;
+#endif
+
+#endif // BUS_HAL_H
@@ -0,0 +1,197 @@
+#ifndef BUS_STATS_H
+#define BUS_STATS_H
+
+#include "bus_hal.h"
+
+// Bus loop latency histograms (build with -DBUS_STATS).
+//
+// Seven log2 histograms in DWT cycles, bucket k counting [2^k, 2^(k+1)):
+//   iter    one pass of the loop, address read to address read
+//   drive   address change to data driven. The change happened somewhere
+//           after the previous pass's address read, so this is the upper
+//           bound the console can see. Phase-locked: PHI2 rise to drive.
+//   dma     the same, for fetches served by the MARIA DMA loop (HALT low)
+//   hit     the same, for fetches served from the sequential prediction
+//           (-DBUS_PREDICT); the hit rate is hit / (drive + dma + hit)
+//   ram     the same, for cart RAM reads (CPU or MARIA); the cost of the RAM
+//           branch is ram against drive
+//   listen  pass through the listen branch (clock recovery, IRQ, sniffer,
+//           one synthesis step), from the address read
+//   free    -DBUS_PHI2_LOCK only: cycles left idle per bus cycle, from the
+//           end of background work to the next PHI2 rise
+// plus the longest listen pass seen and the POKEY writes the sniffer had to
+// drop on a full write queue. Works unchanged in tools/bus_sim, where
+// cycles come from the host clock model.
+//
+// On the Teensy the histograms are printed over USB Serial once the bus has
+// been idle for BUS_STATS_IDLE_CYCLES (console off), then cleared, after
+// the boot timing (bootTiming, bus_engine.h).
+
+#ifndef BUS_STATS_IDLE_CYCLES
+#define BUS_STATS_IDLE_CYCLES (F_CPU / 2)
+#endif
+
+struct Log2Histogram {
+    enum { BUCKETS = 32 };
+    uint32_t count[BUCKETS];
+    uint32_t max;
+
+    void clear() {
+        for (int i = 0; i < BUCKETS; i++) count[i] = 0;
+        max = 0;
+    }
+
+    inline void add(uint32_t cycles) {
+        count[cycles ? 31 - __builtin_clz(cycles) : 0]++;
+        if (cycles > max) max = cycles;
+    }
+
+    uint32_t total() const {
+        uint32_t n = 0;
+        for (int i = 0; i < BUCKETS; i++) n += count[i];
+        return n;
+    }
+
+    void print(const char *name) const {
+        BusHal::logPrintf("# %s: %lu samples, max %lu cycles\n", name,
+                          (unsigned long)total(), (unsigned long)max);
+        for (int i = 0; i < BUCKETS; i++) {
+            if (count[i]) {
+                BusHal::logPrintf("  %8lu+ %lu\n", (unsigned long)(i ? 1UL << i : 0), (unsigned long)count[i]);
+            }
+        }
+    }
+};
+
+class BusStats {
+public:
+    BusStats() { reset(0); }
+
+    void reset(uint32_t now) {
+        m_iter.clear();
+        m_drive.clear();
+        m_dma.clear();
+        m_hit.clear();
+        m_ram.clear();
+        m_listen.clear();
+        m_free.clear();
+        m_lastTop = now;
+        m_lastChange = now;
+        m_changeFrom = now;
+        m_lastAddr = 0xFFFFFFFFu;
+        m_pending = false;
+        m_reported = false;
+    }
+
+    // Right after the address read, every pass.
+    __attribute__((always_inline)) inline void top(uint16_t addr) {
+        uint32_t now = BusHal::cycles();
+        m_iter.add(now - m_lastTop);
+        m_pending = (addr != m_lastAddr);
+        if (m_pending) {
+            m_lastAddr = addr;
+#ifdef BUS_PHI2_LOCK
+            m_changeFrom = now;       // Timed from the PHI2 rise
+#else
+            m_changeFrom = m_lastTop;
+#endif
+            m_lastChange = now;
+            m_reported = false;
+        } else if (!m_reported && (now - m_lastChange) > BUS_STATS_IDLE_CYCLES) {
+            dump();
+            return;
+        }
+        m_lastTop = now;
+    }
+
+    // After the data bus was written (ROM and POKEY read branches).
+    __attribute__((always_inline)) inline void driven() {
+        if (m_pending) {
+            m_drive.add(BusHal::cycles() - m_changeFrom);
+            m_pending = false;
+        }
+    }
+
+    // After a ROM drive in the MARIA DMA loop.
+    __attribute__((always_inline)) inline void drivenDma() {
+        if (m_pending) {
+            m_dma.add(BusHal::cycles() - m_changeFrom);
+            m_pending = false;
+        }
+    }
+
+    // After driving a predicted cell (either loop).
+    __attribute__((always_inline)) inline void drivenPredicted() {
+        if (m_pending) {
+            m_hit.add(BusHal::cycles() - m_changeFrom);
+            m_pending = false;
+        }
+    }
+
+    // After driving a cart RAM byte (any loop).
+    __attribute__((always_inline)) inline void drivenRam() {
+        if (m_pending) {
+            m_ram.add(BusHal::cycles() - m_changeFrom);
+            m_pending = false;
+        }
+    }
+
+    // End of a listen-branch pass.
+    __attribute__((always_inline)) inline void listened() {
+        m_listen.add(BusHal::cycles() - m_lastTop);
+    }
+
+    // Idle cycles ahead of a PHI2 rise (phase-locked mode).
+    __attribute__((always_inline)) inline void freeCycles(uint32_t cycles) {
+        m_free.add(cycles);
+    }
+
+    void print() const {
+        m_iter.print("iter");
+        m_drive.print("drive");
+        m_dma.print("dma");
+#ifdef BUS_PREDICT
+        m_hit.print("hit");
+        uint32_t hits = m_hit.total();
+        uint32_t fetches = hits + m_drive.total() + m_dma.total();
+        BusHal::logPrintf("# predict: %lu of %lu fetches (%lu%%)\n", (unsigned long)hits,
+                          (unsigned long)fetches, (unsigned long)(fetches ? (uint64_t)hits * 100 / fetches : 0));
+#endif
+        if (m_ram.total()) m_ram.print("ram");
+        m_listen.print("listen");
+#ifdef BUS_PHI2_LOCK
+        m_free.print("free");
+#endif
+        BusHal::logPrintf("# pokey: %lu writes dropped by a full queue since boot\n",
+                          (unsigned long)pokey.queueOverflows());
+    }
+
+    // Print and start a new session; the pass spent printing is not counted.
+    __attribute__((noinline)) void dump() {
+        BusHal::logBegin();
+        bootTiming.print();
+        print();
+        BusHal::logEnd();
+        uint32_t addr = m_lastAddr;
+        reset(BusHal::cycles());
+        m_lastAddr = addr;
+        m_reported = true;
+    }
+
+private:
+    Log2Histogram m_iter;
+    Log2Histogram m_drive;
+    Log2Histogram m_dma;
+    Log2Histogram m_hit;
+    Log2Histogram m_ram;
+    Log2Histogram m_listen;
+    Log2Histogram m_free;
+    uint32_t m_lastTop;      // Cycle of the previous address read
+    uint32_t m_lastChange;   // Cycle the current address was first seen
+    uint32_t m_changeFrom;   // Earliest the current address can have appeared
+    uint32_t m_lastAddr;
+    bool     m_pending;      // Address changed this pass, drive not yet timed
+    bool     m_reported;     // Dumped during the current idle stretch
+};
+
+#endif // BUS_STATS_H
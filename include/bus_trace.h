@@ -0,0 +1,145 @@
+#ifndef BUS_TRACE_H
+#define BUS_TRACE_H
+
+#include "bus_hal.h"
+
+// Bus-trace capture (build with -DBUS_TRACE).
+//
+// loop() hands every address it reads to capture(). A record is appended
+// only when the address changes, so a bus cycle that the loop samples
+// dozens of times costs one word:
+//
+//   bits  0-15  address
+//   bit  16     R/W  (1 = read)
+//   bit  17     HALT (1 = CPU active, 0 = Maria DMA)
+//   bits 18-31  DWT cycles since the previous record (saturates at 16383)
+//
+// The ring is an ordinary global, which the Teensy 4 linker places in DTCM.
+// Once the trigger matches, BUS_TRACE_POST more records are taken and the
+// ring freezes. When the bus then sits idle (console off or hung), the
+// frozen ring is dumped over USB Serial oldest-first and capture re-arms.
+
+#ifndef BUS_TRACE_RECORDS
+#define BUS_TRACE_RECORDS 8192          // Power of two; 4 bytes each
+#endif
+
+// Trigger on (record & MASK) == VALUE over bits 0-17. Default: the CPU
+// fetching the reset vector, i.e. capture the boot.
+#ifndef BUS_TRACE_TRIGGER_MASK
+#define BUS_TRACE_TRIGGER_MASK  0x3FFFFu
+#endif
+#ifndef BUS_TRACE_TRIGGER_VALUE
+#define BUS_TRACE_TRIGGER_VALUE 0x3FFFCu  // $FFFC, read, HALT high
+#endif
+
+// Records kept after the trigger (the rest of the ring is pre-trigger history).
+#ifndef BUS_TRACE_POST
+#define BUS_TRACE_POST (BUS_TRACE_RECORDS / 2)
+#endif
+
+// No address change for this long counts as idle (0.5 s at 816 MHz).
+#ifndef BUS_TRACE_IDLE_CYCLES
+#define BUS_TRACE_IDLE_CYCLES (F_CPU / 2)
+#endif
+
+#define BUS_TRACE_DELTA_MAX 0x3FFFu
+
+class BusTrace {
+public:
+    enum { SIZE = BUS_TRACE_RECORDS, MASK = SIZE - 1 };
+
+    BusTrace() { reset(); }
+
+    void reset() {
+        m_head = 0;
+        m_count = 0;
+        m_remaining = 0;
+        m_triggerIndex = 0;
+        m_triggered = false;
+        m_frozen = false;
+        m_lastAddr = 0xFFFFFFFFu; // First sample always records
+        m_lastCycle = BusHal::cycles();
+        m_maxCost = 0;
+    }
+
+    // Fast path (address unchanged) is a cycle read and a compare; the
+    // record path is bounded (no loops). Both are timed, so maxCost() is the
+    // worst case of every call and the dump reports what capture itself
+    // added, including the samples that only compare.
+    __attribute__((always_inline)) inline void capture(uint16_t addr, uint32_t gpio9) {
+        uint32_t now = BusHal::cycles();
+        if (addr != m_lastAddr) {
+            record(addr, gpio9, now);
+        } else if (m_frozen && (now - m_lastCycle) > BUS_TRACE_IDLE_CYCLES) {
+            dump();
+            return;
+        }
+        uint32_t cost = BusHal::cycles() - now;
+        if (cost > m_maxCost) m_maxCost = cost;
+    }
+
+    bool frozen() const { return m_frozen; }
+    uint32_t maxCost() const { return m_maxCost; }
+
+    // Text dump, one record per line: "ADDR R|W HALT DELTA" (hex address,
+    // decimal delta). The trigger record is marked with '*'. Runs with
+    // interrupts on, so the bus is not being served while it prints.
+    __attribute__((noinline)) void dump() {
+        BusHal::logBegin();
+        uint32_t start = (m_count < SIZE) ? 0 : m_head;
+        BusHal::logPrintf("# bus trace: %lu records, max capture cost %lu cycles, f_cpu %lu\n",
+                         (unsigned long)m_count, (unsigned long)m_maxCost, (unsigned long)F_CPU);
+        for (uint32_t i = 0; i < m_count; i++) {
+            uint32_t slot = (start + i) & MASK;
+            uint32_t rec = m_ring[slot];
+            BusHal::logPrintf("%04lX %c %lu %lu%s\n",
+                             (unsigned long)(rec & 0xFFFF),
+                             (rec & (1u << 16)) ? 'R' : 'W',
+                             (unsigned long)((rec >> 17) & 1),
+                             (unsigned long)(rec >> 18),
+                             (m_triggered && slot == m_triggerIndex) ? " *" : "");
+        }
+        BusHal::logPrintf("# end\n");
+        BusHal::logEnd();
+        reset();
+    }
+
+private:
+    uint32_t m_ring[SIZE];
+    uint32_t m_head;
+    uint32_t m_count;         // Records written, saturates at SIZE
+    uint32_t m_remaining;     // Post-trigger records still to take
+    uint32_t m_triggerIndex;  // Ring slot of the trigger record
+    uint32_t m_lastAddr;
+    uint32_t m_lastCycle;
+    uint32_t m_maxCost;
+    bool     m_triggered;
+    bool     m_frozen;
+
+    __attribute__((always_inline)) inline void record(uint16_t addr, uint32_t gpio9, uint32_t now) {
+        uint32_t delta = now - m_lastCycle;
+        m_lastAddr = addr;
+        m_lastCycle = now;
+        if (m_frozen) return;
+
+        if (delta > BUS_TRACE_DELTA_MAX) delta = BUS_TRACE_DELTA_MAX;
+        uint32_t rec = addr
+                     | ((gpio9 << 11) & (1u << 16))   // GPIO9 bit 5: R/W
+                     | ((gpio9 << 9)  & (1u << 17))   // GPIO9 bit 8: HALT
+                     | (delta << 18);
+        m_ring[m_head] = rec;
+
+        if (m_triggered) {
+            if (--m_remaining == 0) m_frozen = true;
+        } else if ((rec & BUS_TRACE_TRIGGER_MASK) == BUS_TRACE_TRIGGER_VALUE) {
+            m_triggered = true;
+            m_triggerIndex = m_head;
+            m_remaining = BUS_TRACE_POST;
+            if (m_remaining == 0) m_frozen = true;
+        }
+        m_head = (m_head + 1) & MASK;
+        if (m_count < SIZE) m_count++;
+    }
+};
+
+#endif // BUS_TRACE_H
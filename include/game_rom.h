@@ -4,7 +4,19 @@
 // Game: Astro Wing Startfighter
 const uint32_t ROM_SIZE = 49152;
 
-uint8_t ROM_DATA[49152] = {
+#define ROM_HAS_HEADER 1
+const uint8_t ROM_HEADER[128] = {
+    0x04, 0x41, 0x54, 0x41, 0x52, 0x49, 0x37, 0x38, 0x30, 0x30, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+    0x20, 0x41, 0x73, 0x74, 0x72, 0x6F, 0x20, 0x57, 0x69, 0x6E, 0x67, 0x20, 0x53, 0x74, 0x61, 0x72,
+    0x74, 0x66, 0x69, 0x67, 0x68, 0x74, 0x65, 0x72, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0xC0, 0x00, 0x00, 0x40, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x41, 0x43, 0x54, 0x55, 0x41, 0x4C, 0x20, 0x43, 0x41, 0x52, 0x54, 0x20,
+    0x44, 0x41, 0x54, 0x41, 0x20, 0x53, 0x54, 0x41, 0x52, 0x54, 0x53, 0x20, 0x48, 0x45, 0x52, 0x45
+};
+
+const uint8_t ROM_DATA[49152] = {
     0xA9, 0x50, 0x85, 0x3C, 0x8D, 0x07, 0x21, 0x20, 0x9A, 0xF4, 0xD0, 0x03, 0x4C, 0x07, 0x40, 0xA9,
     0x3C, 0x8D, 0x4D, 0x25, 0xA9, 0x00, 0x8D, 0xAC, 0x25, 0xA9, 0x00, 0x8D, 0xAB, 0x25, 0xA9, 0x00,
     0x8D, 0xB3, 0x25, 0xA9, 0x00, 0x8D, 0x59, 0x25, 0xA9, 0x00, 0x8D, 0x5A, 0x25, 0xAD, 0xAF, 0x25,
@@ -0,0 +1,159 @@
+#ifndef MAPPERS_H
+#define MAPPERS_H
+
+// Cartridge mappers as compile-time policies.
+//
+// A mapper lays out the page table at boot and says what PAGE_BANK reads
+// return and what CPU writes to PAGE_BANK/PAGE_SWITCH pages do. The bus
+// loop is instantiated once per mapper and the instance is picked once at
+// boot (busEngineServe in bus_engine.h), so a flat cart runs a loop with no
+// banking branches at all and a banked cart carries only its own:
+//
+//   SWITCHED        false compiles the PAGE_BANK/PAGE_SWITCH branches out
+//   MIN_ROM         smallest image the layout can map (else served flat)
+//   CART_RAM        true: $4000-$7FFF is cart RAM (PAGE_CART_RAM, cartRam[]
+//                   in bus_engine.h); false compiles the RAM branches out
+//   begin(...)      page table and bank state for the image and its
+//                   decoded header (CartConfig, a78_header.h)
+//   bankCell(addr)  the cell behind a PAGE_BANK address
+//   write(addr, v)  CPU write of `v` to a PAGE_BANK or PAGE_SWITCH page
+//
+// Banked mappers share cartBank (one 16K window; bus_engine.h).
+
+#include "page_table.h"
+#include "a78_header.h"
+
+extern BankWindow cartBank;
+
+#define MAPPER_INLINE __attribute__((always_inline)) static inline
+
+// Up to 48K ending at $FFFF, nothing switched.
+struct FlatMapper {
+    static constexpr bool SWITCHED = false;
+    static constexpr uint32_t MIN_ROM = 0;
+    static constexpr bool CART_RAM = false;
+
+    static void begin(PageEntry *table, const RomCell *rom, uint32_t romSize, const CartConfig &config) {
+        buildPageTable(table, rom, romSize, config.pokeyAddr);
+    }
+
+    MAPPER_INLINE RomCell bankCell(uint16_t) { return 0; }
+    MAPPER_INLINE void write(uint16_t, uint8_t) {}
+};
+
+// SuperGame: a row of 16K banks. $8000-$BFFF shows the bank last written to
+// that window (bank 0 at reset), $C000-$FFFF the last bank and $4000-$7FFF
+// the one config.rom4000 names: the second-to-last bank, bank 6 (cart type
+// bit 4), or the image's first bank (bit 3, and 144K images), in which case
+// the window runs over the rest and a write of n shows bank n + 1.
+struct SuperGameMapper {
+    static constexpr bool SWITCHED = true;
+    static constexpr uint32_t MIN_ROM = 0x8000;
+    static constexpr bool CART_RAM = false;
+
+    static void begin(PageEntry *table, const RomCell *rom, uint32_t romSize, const CartConfig &config) {
+        uint32_t banks = romSize >> 14;
+        const RomCell *low = rom + ((banks - 2) << 14);
+        cartBank.rom = rom;
+        cartBank.count = banks;
+        if (config.rom4000 == ROM_4000_FIRST) {
+            low = rom;
+            cartBank.rom = rom + (1u << 14);
+            cartBank.count = banks - 1;
+        } else if (config.rom4000 == ROM_4000_BANK6) {
+            low = rom + (6u << 14);
+        }
+
+        mapPages(table, 0x00, 0x40, NULL, PAGE_UNMAPPED);
+        mapPages(table, 0x40, 0x40, low, PAGE_ROM);
+        mapPages(table, 0x80, 0x40, NULL, PAGE_BANK);
+        mapPages(table, 0xC0, 0x40, rom + ((banks - 1) << 14), PAGE_ROM);
+        mapPokey(table, config.pokeyAddr);
+        cartBank.show(0);
+    }
+
+    MAPPER_INLINE RomCell bankCell(uint16_t addr) { return cartBank.at(addr, 0x8000); }
+    MAPPER_INLINE void write(uint16_t, uint8_t value) { cartBank.select(value); }
+};
+
+// Absolute (F18 Hockey): 64K. $4000-$7FFF shows bank 0 or 1, picked by a
+// write to $8000 (bit 0 set: bank 0, else bit 1 set: bank 1); $8000-$FFFF
+// is the last 32K.
+struct AbsoluteMapper {
+    static constexpr bool SWITCHED = true;
+    static constexpr uint32_t MIN_ROM = 0x10000;
+    static constexpr bool CART_RAM = false;
+
+    static void begin(PageEntry *table, const RomCell *rom, uint32_t romSize, const CartConfig &config) {
+        mapPages(table, 0x00, 0x40, NULL, PAGE_UNMAPPED);
+        mapPages(table, 0x40, 0x40, NULL, PAGE_BANK);
+        mapPages(table, 0x80, 0x80, rom + (romSize - 0x8000), PAGE_ROM);
+        table[0x80].kind = PAGE_SWITCH;
+        mapPokey(table, config.pokeyAddr);
+
+        cartBank.rom = rom;
+        cartBank.count = 2;
+        cartBank.show(0);
+    }
+
+    MAPPER_INLINE RomCell bankCell(uint16_t addr) { return cartBank.at(addr, 0x4000); }
+
+    MAPPER_INLINE void write(uint16_t addr, uint8_t value) {
+        if (addr != 0x8000) return;
+        if (value & 1) {
+            cartBank.show(0);
+        } else if (value & 2) {
+            cartBank.show(1);
+        }
+    }
+};
+
+// Activision (Double Dragon, Rampage): 128K as eight 16K banks.
+// $A000-$DFFF shows the bank picked by a write to $FF80-$FF8F (bank =
+// address & 7, the data is ignored). The rest is fixed 8K halves of banks
+// 6 and 7: $4000 bank 6 upper, $6000 bank 6 lower, $8000 bank 7 upper,
+// $E000 bank 7 lower.
+struct ActivisionMapper {
+    static constexpr bool SWITCHED = true;
+    static constexpr uint32_t MIN_ROM = 0x20000;
+    static constexpr bool CART_RAM = false;
+
+    static void begin(PageEntry *table, const RomCell *rom, uint32_t, const CartConfig &config) {
+        const RomCell *bank6 = rom + (6u << 14);
+        const RomCell *bank7 = rom + (7u << 14);
+
+        mapPages(table, 0x00, 0x40, NULL, PAGE_UNMAPPED);
+        mapPages(table, 0x40, 0x20, bank6 + 0x2000, PAGE_ROM);
+        mapPages(table, 0x60, 0x20, bank6, PAGE_ROM);
+        mapPages(table, 0x80, 0x20, bank7 + 0x2000, PAGE_ROM);
+        mapPages(table, 0xA0, 0x40, NULL, PAGE_BANK);
+        mapPages(table, 0xE0, 0x20, bank7, PAGE_ROM);
+        table[0xFF].kind = PAGE_SWITCH;
+        mapPokey(table, config.pokeyAddr);
+
+        cartBank.rom = rom;
+        cartBank.count = 8;
+        cartBank.show(0);
+    }
+
+    MAPPER_INLINE RomCell bankCell(uint16_t addr) { return cartBank.at(addr, 0xA000); }
+
+    MAPPER_INLINE void write(uint16_t addr, uint8_t) {
+        if ((addr & 0xFFF0) == 0xFF80) cartBank.show(addr & 7);
+    }
+};
+
+// `Base`'s layout with 16K of cart RAM over $4000-$7FFF (POKEY at $4000
+// still takes its page).
+template <class Base>
+struct CartRamMapper : Base {
+    static constexpr bool CART_RAM = true;
+
+    static void begin(PageEntry *table, const RomCell *rom, uint32_t romSize, const CartConfig &config) {
+        Base::begin(table, rom, romSize, config);
+        mapPages(table, 0x40, 0x40, NULL, PAGE_CART_RAM);
+        mapPokey(table, config.pokeyAddr);
+    }
+};
+
+#endif // MAPPERS_H
@@ -0,0 +1,88 @@
+#ifndef PAGE_TABLE_H
+#define PAGE_TABLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// 256-entry address dispatch, one entry per 256-byte page (addr >> 8).
+//
+// The bus loop classifies an address with one table load instead of a chain
+// of range compares, and ROM pages point straight at their backing bytes, so
+// new cartridge layouts only change how the table is built at boot.
+
+// What the bus loop stores per ROM byte: the byte itself, or the full
+// GPIO6_DR word with -DROM_WORD_IMAGE (see bus_engine.h).
+#ifdef ROM_WORD_IMAGE
+typedef uint32_t RomCell;
+#else
+typedef uint8_t RomCell;
+#endif
+
+enum PageKind {
+    PAGE_ROM = 0,     // Drive base[addr & 0xFF] (zero: cheapest compare)
+    PAGE_BANK,        // Switched window: the mapper's bankCell(addr); writes go to the mapper
+    PAGE_SWITCH,      // Fixed ROM like PAGE_ROM, but writes go to the mapper
+    PAGE_POKEY,       // Page holding POKEY; IS_POKEY_ADDR() narrows it down
+    PAGE_CART_RAM,    // 16K cart RAM at $4000-$7FFF: cartRam[addr & 0x3FFF]
+    PAGE_UNMAPPED     // Console space or open bus: listen only
+};
+
+struct PageEntry {
+    const RomCell *base;  // Start of this page in the backing memory, or NULL
+    uint8_t kind;
+};
+
+// `count` pages from `first` of one kind, backed by consecutive memory from
+// `src` (NULL: no backing of their own).
+inline void mapPages(PageEntry *table, uint32_t first, uint32_t count, const RomCell *src, uint8_t kind) {
+    for (uint32_t page = first; page < first + count; page++) {
+        table[page].base = src ? src + ((page - first) << 8) : NULL;
+        table[page].kind = kind;
+    }
+}
+
+// POKEY in page `pokeyAddr >> 8` (0 for none). Called last, so POKEY takes
+// the page whatever the layout put there: at $4000 it covers the first page
+// of a 48K flat cart, a SuperGame fixed bank or cart RAM, and the rest of
+// that page listens.
+inline void mapPokey(PageEntry *table, uint16_t pokeyAddr) {
+    if (pokeyAddr) {
+        table[pokeyAddr >> 8].base = NULL;
+        table[pokeyAddr >> 8].kind = PAGE_POKEY;
+    }
+}
+
+// Flat cartridge: `romSize` bytes of `rom` ending at $FFFF (at most 48K).
+inline void buildPageTable(PageEntry *table, const RomCell *rom, uint32_t romSize, uint16_t pokeyAddr) {
+    if (romSize > 0xC000) romSize = 0xC000;
+    uint32_t romPages = romSize >> 8;
+
+    mapPages(table, 0, 256 - romPages, NULL, PAGE_UNMAPPED);
+    mapPages(table, 256 - romPages, romPages, rom, PAGE_ROM);
+    mapPokey(table, pokeyAddr);
+}
+
+// A 16K window onto a row of 16K banks (see mappers.h). The window pages
+// carry no base of their own: switching banks moves the one pointer here,
+// however large the cart is.
+struct BankWindow {
+    const RomCell *rom;   // Bank 0
+    const RomCell *base;  // Bank now in the window
+    uint32_t count;       // Banks in the image
+
+    __attribute__((always_inline)) inline void show(uint32_t bank) {
+        base = rom + (bank << 14);
+    }
+
+    // A bank number as the CPU wrote it, wrapped to the image.
+    __attribute__((always_inline)) inline void select(uint8_t value) {
+        show(value < count ? value : value % count);
+    }
+
+    // Cell behind `addr` in a window starting at `start`.
+    __attribute__((always_inline)) inline RomCell at(uint16_t addr, uint16_t start) const {
+        return base[(uint16_t)(addr - start) & 0x3FFF];
+    }
+};
+
+#endif // PAGE_TABLE_H
@@ -0,0 +1,77 @@
+#ifndef SD_ROM_H
+#define SD_ROM_H
+
+// Cart image from the Teensy 4.1 SD slot at boot (build with -DROM_FROM_SD).
+//
+// ROM_SD_PATH is streamed into sdRomImage through a78_loader.h and replaces
+// the built-in game_rom.h image, and its header the cart config, so
+// changing games is copying a file to the card. Without a card or a valid
+// image the built-in one is served.
+// Included from main.cpp, after bus_engine.h.
+
+#include <SD.h>
+#include "a78_loader.h"
+
+#ifndef ROM_SD_PATH
+#define ROM_SD_PATH "game.a78"
+#endif
+
+// Largest image: 144K holds Activision carts (128K) and SuperGame carts up
+// to nine banks. 256K and 512K SuperGame images need SD_ROM_MAX raised (and
+// the room for it in DTCM); without that they are rejected with
+// A78_OVER_LIMIT, reported with both sizes at boot, and the built-in image
+// is served.
+#ifndef SD_ROM_MAX
+#define SD_ROM_MAX (144u * 1024)
+#endif
+
+// An ordinary global, so it lands in DTCM like the rest of the bus state
+// (the loop reads ROM from here on every fetch).
+uint8_t sdRomImage[SD_ROM_MAX];
+
+// Largest image accepted. With -DROM_WORD_IMAGE the word image must hold
+// all of it too: a larger one is rejected as over the limit and the
+// built-in image served, rather than cut short (a banked cart losing its top banks
+// would fall back to the flat layout).
+#ifdef ROM_WORD_IMAGE
+#define SD_ROM_LOAD_MAX (ROM_WORDS_MAX < SD_ROM_MAX ? (uint32_t)ROM_WORDS_MAX : SD_ROM_MAX)
+#else
+#define SD_ROM_LOAD_MAX SD_ROM_MAX
+#endif
+
+struct SdFileSource {
+    File file;
+
+    size_t read(uint8_t *dst, size_t n) {
+        int got = file.read(dst, n);
+        return got > 0 ? (size_t)got : 0;
+    }
+};
+
+// Loads the image and points the engine's cart globals at it; fills the SD
+// part of bootTiming.
+inline A78Status loadRomFromSd() {
+    if (!SD.begin(BUILTIN_SDCARD)) return A78_NO_FILE;
+    SdFileSource src;
+    src.file = SD.open(ROM_SD_PATH, FILE_READ);
+    if (!src.file) return A78_NO_FILE;
+    bootTiming.sdReady = BusHal::cycles();
+
+    A78Image image;
+    A78Status status = loadA78(src, sdRomImage, SD_ROM_LOAD_MAX, image);
+    src.file.close();
+    if (status == A78_OVER_LIMIT) {
+        bootTiming.sdRomSize = image.config.romSize;
+        bootTiming.sdLimit = SD_ROM_LOAD_MAX;
+    }
+    if (status != A78_OK) return status;
+
+    cartRom = sdRomImage;
+    cartRomSize = image.config.romSize;
+    cartConfig = image.config;
+    bootTiming.romBytes = image.config.romSize;
+    bootTiming.reads = image.reads;
+    return A78_OK;
+}
+
+#endif // SD_ROM_H
@@ -0,0 +1,121 @@
+#ifndef POKEY_IRQ_H
+#define POKEY_IRQ_H
+
+#include <stdint.h>
+#include "pokey.h"
+
+// POKEY timer 1/2/4 interrupts, scheduled in DWT cycles.
+//
+// Runs in bus time, not synthesis time: writes are fed in as they are
+// committed by the sniffer, so an IRQEN acknowledge drops the line before
+// the CPU's RTI. Each enabled timer's next underflow is precomputed and the
+// earliest one is exposed as nextIrqCycle(), so the bus loop only needs a
+// single compare per iteration.
+class PokeyIrqScheduler {
+public:
+    PokeyIrqScheduler() : m_cyclesPerClock16(0) { reset(0); }
+
+    void reset(uint32_t now) {
+        for (int i = 0; i < 4; i++) m_audf[i] = 0;
+        m_audctl = 0;
+        m_enable = 0;
+        m_status = 0xFF;
+        for (int t = 0; t < 3; t++) m_due[t] = now;
+        recompute(now);
+    }
+
+    // DWT cycles per 64 kHz sample, converted to cycles per 1.79 MHz clock (16.16).
+    void setCyclesPerSample(uint32_t cyclesPerSample) {
+        m_cyclesPerClock16 = (uint32_t)(((uint64_t)cyclesPerSample << 16) / Pokey::CLOCKS_PER_TICK);
+    }
+
+    // One committed register write (chip 0 registers only).
+    void noteWrite(uint32_t cycle, uint8_t reg, uint8_t value) {
+        switch (reg) {
+            case 0x00: case 0x02: case 0x04: case 0x06:
+                // New AUDF takes effect at the next reload.
+                m_audf[reg >> 1] = value;
+                return;
+
+            case 0x08: // AUDCTL
+                m_audctl = value;
+                return;
+
+            case 0x09: // STIMER restarts every timer
+                for (int t = 0; t < 3; t++) {
+                    m_due[t] = cycle + periodCycles(t);
+                }
+                break;
+
+            case 0x0E: { // IRQEN: disabled sources drop their pending bit
+                // Timers keep counting while masked, so a re-enabled timer
+                // resumes on its original phase (ack + re-enable is the norm).
+                uint8_t newly = value & ~m_enable;
+                for (int t = 0; t < 3; t++) {
+                    int32_t late = (int32_t)(cycle - m_due[t]);
+                    if ((newly & (1 << t)) && late >= 0) {
+                        uint32_t period = periodCycles(t);
+                        m_due[t] += ((uint32_t)late / period + 1) * period;
+                    }
+                }
+                m_enable = value;
+                m_status |= (uint8_t)~value;
+                break;
+            }
+
+            default:
+                return;
+        }
+        recompute(cycle);
+    }
+
+    // Called once the bus loop passes nextIrqCycle(): latch every enabled
+    // timer that underflowed and schedule its next period. Masked timers are
+    // moved along too (without latching), so their m_due never falls out of
+    // the signed compare window however long they stay masked; recompute()
+    // brings the loop back here at least every 2^30 cycles.
+    void service(uint32_t now) {
+        for (int t = 0; t < 3; t++) {
+            int32_t late = (int32_t)(now - m_due[t]);
+            if (late >= 0) {
+                uint32_t period = periodCycles(t);
+                if (m_enable & (1 << t)) m_status &= (uint8_t)~(1 << t);
+                m_due[t] += ((uint32_t)late / period + 1) * period;
+            }
+        }
+        recompute(now);
+    }
+
+    uint32_t nextIrqCycle() const { return m_next; }
+    uint8_t status() const { return m_status; }           // IRQST, active low
+    bool asserted() const { return (~m_status & m_enable & 0x07) != 0; }
+
+private:
+    uint8_t  m_audf[4];
+    uint8_t  m_audctl;
+    uint8_t  m_enable;      // IRQEN
+    uint8_t  m_status;      // IRQST
+    uint32_t m_due[3];      // Next underflow of timers 1, 2, 4
+    uint32_t m_next;
+    uint32_t m_cyclesPerClock16;
+
+    uint32_t periodCycles(int timer) const {
+        static const uint8_t channel[3] = {0, 1, 3};
+        uint32_t clocks = Pokey::ClockPeriod(m_audctl, m_audf, channel[timer]);
+        uint32_t cycles = (uint32_t)(((uint64_t)clocks * m_cyclesPerClock16) >> 16);
+        return cycles ? cycles : 1;
+    }
+
+    // With nothing enabled, park the compare well inside the signed window;
+    // a service() there re-parks it and carries the masked timers forward.
+    void recompute(uint32_t now) {
+        m_next = now + 0x40000000u;
+        for (int t = 0; t < 3; t++) {
+            if ((m_enable & (1 << t)) && (int32_t)(m_due[t] - m_next) < 0) {
+                m_next = m_due[t];
+            }
+        }
+    }
+};
+
+#endif // POKEY_IRQ_H
@@ -2,31 +2,167 @@
 #define POKEY_WRAPPER_H
 
 #include "pokey.h" 
-#include <Arduino.h>
+#include "PokeyWriteQueue.h"
+#include "PokeyIrq.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef POKEY_STEREO
+#include "dual_pokey.h"
+#endif
+
+// -DPOKEY_BLEP adds the band-limited render (PokeyBlep) for a fixed-rate
+// audio path; the PWM output does not use it, so firmware builds leave
+// its buffer out.
+#if defined(POKEY_BLEP) && !defined(POKEY_STEREO)
+#include "pokey_blep.h"
+#endif
 
 class PokeyWrapper {
 private:
+#ifdef POKEY_STEREO
+    DualPokey m_pokey;  // Left at cartConfig.pokeyAddr, right 16 bytes up
+#else
     Pokey m_pokey;
+#ifdef POKEY_BLEP
+    PokeyBlep m_blep;
+#endif
+#endif
+    PokeyWriteQueue m_queue;
+    PokeyIrqScheduler m_irq;
 
 public:
+#ifdef POKEY_STEREO
+    static const uint8_t STEPS_PER_SAMPLE = DualPokey::STEPS_PER_SAMPLE;
+    static const uint8_t REG_MASK = 0x1F;
+#else
+    static const uint8_t STEPS_PER_SAMPLE = Pokey::STEPS_PER_SAMPLE;
+    static const uint8_t REG_MASK = 0x0F;
+#endif
+
     PokeyWrapper() {
         // Leave this EMPTY. No hardware or complex logic here.
     }
 
-    void begin() {
+    void begin(uint32_t now, uint32_t cyclesPerSample) {
         m_pokey.Reset(); // Safe to call now
+#if defined(POKEY_BLEP) && !defined(POKEY_STEREO)
+        m_blep.Reset();
+#endif
+        m_irq.setCyclesPerSample(cyclesPerSample);
+        m_irq.reset(now);
     }
 
     bool tickStep() {
         return m_pokey.TickStep();
     }
 
+    // Distributed path: apply at most one queued write that is due by the
+    // time this step represents, then advance one step.
+    bool tickStep(uint32_t stepCycle) {
+        PokeyWrite w;
+        if (m_queue.popDue(stepCycle, w)) {
+            m_pokey.Write(w.reg, w.value);
+        }
+        return m_pokey.TickStep();
+    }
+
+#ifdef POKEY_STEREO
+    uint8_t getOutput() {
+        return m_pokey.GetOutput(0);
+    }
+
+    uint8_t getOutputRight() {
+        return m_pokey.GetOutput(1);
+    }
+#else
+    // Render a block of samples in one pass (render-ahead path).
+    void render(uint8_t* out, size_t count) {
+        m_pokey.Render(out, count);
+    }
+
+    // Render-ahead with queued writes applied on the sample they land in.
+    // Sample n covers [startCycle + n * cyclesPerSample, ...).
+    void render(uint8_t* out, size_t count, uint32_t startCycle, uint32_t cyclesPerSample) {
+        size_t n = 0;
+        while (n < count) {
+            if (!m_queue.empty()) {
+                int32_t due = (int32_t)(m_queue.front().cycle - startCycle);
+                size_t at = due <= 0 ? 0 : (size_t)due / cyclesPerSample;
+                if (at <= n) {
+                    m_pokey.Write(m_queue.front().reg, m_queue.front().value);
+                    m_queue.pop();
+                    continue;
+                }
+                if (at < count) {
+                    m_pokey.Render(out + n, at - n);
+                    n = at;
+                    continue;
+                }
+            }
+            m_pokey.Render(out + n, count - n);
+            n = count;
+        }
+    }
+
+#ifdef POKEY_BLEP
+    // Band-limited render at a fixed output rate (see PokeyBlep).
+    void setOutputRate(uint32_t sampleRate) {
+        m_blep.SetOutputRate(sampleRate);
+    }
+
+    void renderBandLimited(uint8_t* out, size_t count) {
+        m_blep.Render(m_pokey, out, count);
+    }
+#endif
+
     uint8_t getOutput() {
         return m_pokey.GetOutput(); 
     }
+#endif
 
     void writeRegister(uint8_t addr, uint8_t val) {
-        m_pokey.Write(addr & 0x0F, val);
+        m_pokey.Write(addr & REG_MASK, val);
+    }
+
+    // Response bytes for bus reads, indexed by (addr - cartConfig.pokeyAddr)
+    // & REG_MASK.
+    // The table is kept current by the engine, so serving a read is one load.
+    const uint8_t* readRegisters() const {
+        return m_pokey.ReadRegisters();
+    }
+
+    // Producer side of the write queue, for the bus sniffer.
+    PokeyWriteQueue& writeQueue() {
+        return m_queue;
+    }
+
+    uint32_t queueOverflows() const {
+        return m_queue.overflows();
+    }
+
+    // --- Timer IRQs (bus time) ---
+    // Feed each committed write; IRQ registers only live on the first chip.
+    void noteWrite(uint32_t cycle, uint8_t reg, uint8_t value) {
+        if (reg < 0x10) {
+            m_irq.noteWrite(cycle, reg, value);
+            m_pokey.SetIrqStatus(m_irq.status());
+        }
+    }
+
+    // Call once `now` passes nextIrqCycle(); returns the new compare value.
+    uint32_t serviceIrq(uint32_t now) {
+        m_irq.service(now);
+        m_pokey.SetIrqStatus(m_irq.status());
+        return m_irq.nextIrqCycle();
+    }
+
+    uint32_t nextIrqCycle() const {
+        return m_irq.nextIrqCycle();
+    }
+
+    bool irqAsserted() const {
+        return m_irq.asserted();
     }
 };
 
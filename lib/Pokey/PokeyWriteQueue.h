@@ -0,0 +1,82 @@
+#ifndef POKEY_WRITE_QUEUE_H
+#define POKEY_WRITE_QUEUE_H
+
+#include <stdint.h>
+
+// Timestamped POKEY register write, as seen by the bus sniffer.
+struct PokeyWrite {
+    uint32_t cycle;   // DWT cycle the write was first seen on the bus
+    uint8_t  reg;
+    uint8_t  value;
+};
+
+// Single-producer / single-consumer ring between the bus sniffer and the
+// synthesizer. No locks: the producer only moves m_head, the consumer only
+// moves m_tail. Pure C++ so it builds on the host as well.
+//
+// A bus write stays on the address lines for many loop iterations and the
+// data settles late in the cycle, so the producer stages into the head slot
+// (re-staging just refreshes the value) and commits once the address moves on.
+class PokeyWriteQueue {
+public:
+    enum { SIZE = 64, MASK = SIZE - 1 };
+
+    PokeyWriteQueue() : m_head(0), m_tail(0), m_overflows(0), m_staged(false) {}
+
+    // --- Producer (bus loop) ---
+    inline void stage(uint32_t cycle, uint8_t reg, uint8_t value) {
+        PokeyWrite &slot = m_entries[m_head];
+        if (!m_staged) {
+            slot.cycle = cycle;
+            m_staged = true;
+        }
+        slot.reg = reg;
+        slot.value = value;
+    }
+
+    inline bool isStaged() const { return m_staged; }
+
+    inline const PokeyWrite& staged() const { return m_entries[m_head]; }
+
+    inline void commit() {
+        m_staged = false;
+        uint32_t next = (m_head + 1) & MASK;
+        if (next == m_tail) {
+            m_overflows++; // Full: drop, the slot is reused by the next write
+            return;
+        }
+        asm volatile ("" ::: "memory");
+        m_head = next;
+    }
+
+    // --- Consumer (audio renderer) ---
+    inline bool empty() const { return m_head == m_tail; }
+
+    inline const PokeyWrite& front() const { return m_entries[m_tail]; }
+
+    inline void pop() {
+        asm volatile ("" ::: "memory");
+        m_tail = (m_tail + 1) & MASK;
+    }
+
+    // Pop the oldest write if it is due at or before `cycle`.
+    inline bool popDue(uint32_t cycle, PokeyWrite &out) {
+        if (empty()) return false;
+        const PokeyWrite &w = front();
+        if ((int32_t)(w.cycle - cycle) > 0) return false;
+        out = w;
+        pop();
+        return true;
+    }
+
+    uint32_t overflows() const { return m_overflows; }
+
+private:
+    PokeyWrite m_entries[SIZE];
+    volatile uint32_t m_head;
+    volatile uint32_t m_tail;
+    uint32_t m_overflows;
+    bool m_staged;
+};
+
+#endif // POKEY_WRITE_QUEUE_H
@@ -0,0 +1,248 @@
+#include "dual_pokey.h"
+#include <string.h>
+
+#define LANES_01 0x01010101u
+#define LANES_7F 0x7F7F7F7Fu
+
+DualPokey::DualPokey() {
+    Reset();
+}
+
+void DualPokey::Reset() {
+    memset(m_regs, 0, sizeof(m_regs));
+    memset(m_counter, 0, sizeof(m_counter));
+    memset(m_divisor, 0, sizeof(m_divisor));
+    memset(m_output, 0, sizeof(m_output));
+    memset(m_volume, 0, sizeof(m_volume));
+    memset(m_volOnly, 0, sizeof(m_volOnly));
+    memset(m_cachedOutput, 0, sizeof(m_cachedOutput));
+    m_polyState = 0;
+    m_tickStep = 0;
+    m_poly.Reset();
+
+    memset(m_audctl, 0, sizeof(m_audctl));
+    memset(m_clockCounter, 0, sizeof(m_clockCounter));
+    memset(m_clockPeriod, 0, sizeof(m_clockPeriod));
+    memset(m_flip, 0, sizeof(m_flip));
+    memset(m_highPass, 0, sizeof(m_highPass));
+
+    // Same idle values as Pokey::ResetReadRegisters().
+    memset(m_readRegs, 0xFF, sizeof(m_readRegs));
+    for (int chip = 0; chip < 2; chip++) {
+        memset(m_readRegs[chip], 0xE4, 8);
+        m_readRegs[chip][0x08] = 0x00;
+        m_readRegs[chip][0x0A] = m_poly.Random17();
+    }
+
+    for (int chip = 0; chip < 2; chip++) {
+        for (int i = 0; i < 4; i++) {
+            UpdateChannel(chip, i);
+        }
+    }
+}
+
+// Shared clock and reset: both chips see the same poly bits and RANDOM.
+inline void DualPokey::UpdatePoly() {
+    m_polyState = m_poly.Next();
+    uint8 random = m_poly.Random17();
+    m_readRegs[0][0x0A] = random;
+    m_readRegs[1][0x0A] = random;
+}
+
+// Rebuild channel lanes derived from AUDC: volume, volume-only, distortion gates.
+void DualPokey::UpdateChannel(int chip, int channel) {
+    uint8 audc = m_regs[chip][channel * 2 + 1];
+    uint32 shift = channel * 8;
+    uint32 lane = 0xFFu << shift;
+
+    m_volume[chip]  = (m_volume[chip] & ~lane) | ((uint32)(audc & 0x0F) << shift);
+    m_volOnly[chip] = (m_volOnly[chip] & ~lane) | ((audc & 0x10) ? lane : 0);
+
+    const uint8* lut = Pokey::DistortionLUT[(audc >> 5) & 0x07];
+    for (int p = 0; p < 16; p++) {
+        m_gate[chip][p] = (m_gate[chip][p] & ~lane) | (lut[p] ? lane : 0);
+    }
+}
+
+void DualPokey::Write(uint8 addr, uint8 val) {
+    int chip = (addr >> 4) & 1;
+    addr &= 0x0F;
+    m_regs[chip][addr] = val;
+
+    if (addr < 8) {
+        int channel = addr >> 1;
+        if (addr & 1) {
+            UpdateChannel(chip, channel);
+        } else {
+            uint32 shift = channel * 8;
+            m_divisor[chip] = (m_divisor[chip] & ~(0xFFu << shift)) | ((uint32)val << shift);
+            if (m_audctl[chip]) {
+                UpdateClockPeriods(chip);
+            }
+        }
+    } else if (addr == 8) { // AUDCTL
+        SetAudctl(chip, val);
+    } else if (addr == 9) { // STIMER
+        m_counter[chip] = m_divisor[chip];
+        if (m_audctl[chip]) {
+            for (int i = 0; i < 4; i++) {
+                m_clockCounter[chip][i] = (sint32)m_clockPeriod[chip][i];
+            }
+        }
+    }
+}
+
+// Same hand-over as Pokey::SetAudctl(), between the packed lanes and the
+// per-channel clock counters.
+void DualPokey::SetAudctl(int chip, uint8 val) {
+    uint8 old = m_audctl[chip];
+    m_audctl[chip] = val;
+
+    if (val && !old) {
+        for (int i = 0; i < 4; i++) {
+            uint32 counter = (m_counter[chip] >> (i * 8)) & 0xFF;
+            m_clockCounter[chip][i] = (sint32)((counter + 1) * Pokey::CLOCKS_PER_TICK);
+            m_flip[chip][i] = (uint8)((m_output[chip] >> (i * 8)) & 1);
+        }
+    } else if (!val && old) {
+        uint32 counter = 0;
+        uint32 output = 0;
+        for (int i = 0; i < 4; i++) {
+            sint32 ticks = (m_clockCounter[chip][i] + Pokey::CLOCKS_PER_TICK - 1) / Pokey::CLOCKS_PER_TICK;
+            uint32 c = ticks <= 0 ? 0 : (ticks > 256 ? 255 : (uint32)ticks - 1);
+            counter |= c << (i * 8);
+            output |= (uint32)m_flip[chip][i] << (i * 8);
+        }
+        m_counter[chip] = counter;
+        m_output[chip] = output;
+    }
+
+    if (!(val & 0x04)) m_highPass[chip][0] = 0;
+    if (!(val & 0x02)) m_highPass[chip][1] = 0;
+    if (val) {
+        UpdateClockPeriods(chip);
+    }
+}
+
+void DualPokey::UpdateClockPeriods(int chip) {
+    uint8 divisor[4];
+    for (int i = 0; i < 4; i++) {
+        divisor[i] = m_regs[chip][i * 2];
+    }
+    for (int i = 0; i < 4; i++) {
+        m_clockPeriod[chip][i] = Pokey::ClockPeriod(m_audctl[chip], divisor, i);
+    }
+}
+
+// Pokey::StepAudctlTimers() for one chip, leaving the outputs in its lanes.
+void DualPokey::StepAudctlTimers(int chip) {
+    uint8 audctl = m_audctl[chip];
+    if (audctl & 0x80) {
+        m_readRegs[chip][0x0A] = m_poly.Random9();
+    }
+
+    uint8* flip = m_flip[chip];
+    uint8* highPass = m_highPass[chip];
+    uint8 underflow = 0;
+    for (int i = 0; i < 4; i++) {
+        if (m_regs[chip][i * 2 + 1] & 0x10) {
+            flip[i] = 1;
+            continue;
+        }
+        sint32 c = m_clockCounter[chip][i] - Pokey::CLOCKS_PER_TICK;
+        if (c <= 0) {
+            uint32 period = m_clockPeriod[chip][i];
+            uint32 n = 1 + (uint32)(-c) / period;
+            c += (sint32)(n * period);
+            flip[i] ^= (uint8)(n & 1);
+            underflow |= (uint8)(1 << i);
+        }
+        m_clockCounter[chip][i] = c;
+    }
+
+    if ((audctl & 0x04) && (underflow & 0x04)) highPass[0] = flip[0];
+    if ((audctl & 0x02) && (underflow & 0x08)) highPass[1] = flip[1];
+
+    uint32 output = ((audctl & 0x10) ? 0 : (uint32)(flip[0] ^ highPass[0]))
+                  | ((uint32)(flip[1] ^ highPass[1]) << 8)
+                  | ((audctl & 0x08) ? 0 : (uint32)flip[2] << 16)
+                  | ((uint32)flip[3] << 24);
+    // Volume-only lanes stay high past the high-pass and pair muting.
+    m_output[chip] = output | (m_volOnly[chip] & LANES_01);
+}
+
+// One tick for all four lanes: zero lanes reload and toggle, the rest
+// decrement. Volume-only lanes hold their counter and force the output high.
+inline void DualPokey::StepTimers(int chip) {
+    if (m_audctl[chip]) {
+        StepAudctlTimers(chip);
+        return;
+    }
+
+    uint32 c = m_counter[chip];
+    uint32 running = ~m_volOnly[chip];
+
+    // 0x80 in every lane that is exactly zero (no cross-lane borrow).
+    uint32 zero = ~(((c & LANES_7F) + LANES_7F) | c | LANES_7F);
+    uint32 zeroMask = (zero >> 7) * 0xFF;
+
+    // Non-zero lanes are >= 1, so subtracting 1 there never borrows.
+    uint32 next = ((c & ~zeroMask) - (LANES_01 & ~zeroMask)) | (m_divisor[chip] & zeroMask);
+    m_counter[chip] = (next & running) | (c & ~running);
+
+    m_output[chip] ^= (zero >> 7) & running;
+    m_output[chip] |= m_volOnly[chip] & LANES_01;
+}
+
+inline uint8 DualPokey::Mix(int chip) const {
+    // With AUDCTL bit 7 the 9-bit poly stands in for the 17-bit one.
+    uint8 poly = (m_audctl[chip] & 0x80)
+               ? (uint8)((m_polyState & 0x07) | ((m_polyState & 0x04) << 1)) : m_polyState;
+    uint32 on = (m_output[chip] * 0xFF) & m_gate[chip][poly];
+    // Sum the four volume lanes into the top byte (max 60, no overflow).
+    return (uint8)(((m_volume[chip] & on) * LANES_01) >> 24);
+}
+
+bool DualPokey::TickStep() {
+    switch (m_tickStep) {
+        case 0:
+            UpdatePoly();
+            m_tickStep = 1;
+            break;
+
+        case 1:
+            StepTimers(0);
+            m_tickStep = 2;
+            break;
+
+        case 2:
+            StepTimers(1);
+            m_tickStep = 3;
+            break;
+
+        case 3:
+            m_cachedOutput[0] = Mix(0);
+            m_cachedOutput[1] = Mix(1);
+            m_tickStep = 0;
+            return true;
+    }
+    return false;
+}
+
+void DualPokey::Render(uint8* left, uint8* right, size_t count) {
+    while (m_tickStep != 0) {
+        TickStep();
+    }
+
+    for (size_t n = 0; n < count; n++) {
+        UpdatePoly();
+        StepTimers(0);
+        StepTimers(1);
+        left[n] = Mix(0);
+        right[n] = Mix(1);
+    }
+    if (count) {
+        m_cachedOutput[0] = left[count - 1];
+        m_cachedOutput[1] = right[count - 1];
+    }
+}
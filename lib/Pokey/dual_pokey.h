@@ -0,0 +1,71 @@
+#ifndef DUAL_POKEY_H
+#define DUAL_POKEY_H
+
+#include "typedefs.h"
+#include "pokey.h"
+#include <stddef.h>
+
+// Two POKEYs (stereo carts: left at the cart's POKEY base, right 16 bytes
+// up, so $0440 and $0450 on dual-POKEY carts) with each chip's four channels
+// packed one byte per lane into 32-bit words, so a chip's timers and mix
+// are a handful of word operations (SWAR) instead of four branchy
+// per-channel passes. Both chips share one poly cursor, as they would on a
+// common clock and reset.
+//
+// A chip with AUDCTL set leaves the packed step for the same 1.79 MHz
+// divider model as Pokey (joined pairs, fast clocks, 15 kHz base,
+// high-pass, 9-bit poly); the other chip stays packed.
+class DualPokey {
+public:
+    enum {
+        MAX_OUTPUT = Pokey::MAX_OUTPUT,
+        STEPS_PER_SAMPLE = 4   // TickStep() calls per output sample
+    };
+
+    DualPokey();
+    void Reset();
+    void Write(uint8 addr, uint8 val);  // addr bit 4 selects the chip
+    bool TickStep();
+    void Render(uint8* left, uint8* right, size_t count);
+    uint8 GetOutput(int chip) const { return m_cachedOutput[chip]; }
+
+    // Both chips' readable registers back to back (base to base + $1F order).
+    const uint8* ReadRegisters() const { return &m_readRegs[0][0]; }
+
+    // IRQST readback for the first chip (timer IRQs come from it only).
+    void SetIrqStatus(uint8 status) { m_readRegs[0][0x0E] = status; }
+
+private:
+    uint8  m_regs[2][16];
+    uint8  m_readRegs[2][16];
+
+    // Packed per chip: lane i (bits 8i..8i+7) is channel i.
+    uint32 m_counter[2];
+    uint32 m_divisor[2];
+    uint32 m_output[2];    // 0x01 per lane when the flip-flop is high
+    uint32 m_volume[2];    // AUDC & 0x0F per lane
+    uint32 m_volOnly[2];   // 0xFF per lane in volume-only mode
+    uint32 m_gate[2][16];  // 0xFF per lane where the distortion passes, by poly state
+
+    // AUDCTL kernel state per chip (only touched while that AUDCTL != 0)
+    uint8  m_audctl[2];
+    sint32 m_clockCounter[2][4];  // 1.79 MHz clocks until next underflow
+    uint32 m_clockPeriod[2][4];   // Underflow period in 1.79 MHz clocks
+    uint8  m_flip[2][4];          // Raw divider flip-flops
+    uint8  m_highPass[2][2];      // High-pass latches for channels 1 and 2
+
+    PokeyPoly m_poly;
+    uint8  m_polyState;
+    uint8  m_tickStep;
+    uint8  m_cachedOutput[2];
+
+    void UpdatePoly();
+    void UpdateChannel(int chip, int channel);
+    void StepTimers(int chip);
+    void SetAudctl(int chip, uint8 val);
+    void UpdateClockPeriods(int chip);
+    void StepAudctlTimers(int chip);
+    uint8 Mix(int chip) const;
+};
+
+#endif // DUAL_POKEY_H
@@ -12,6 +12,102 @@ const uint8_t Pokey::DistortionLUT[8][16] = {
     {1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1}  // 7: Pure
 };
 
+uint32 PokeyPoly::Poly4Table[1];
+uint32 PokeyPoly::Poly5Table[1];
+uint32 PokeyPoly::Poly9Table[(POLY9_LEN + 31) / 32 + 2];
+uint32 PokeyPoly::Poly17Table[(POLY17_LEN + 31) / 32 + 2];
+bool   PokeyPoly::TablesBuilt = false;
+
+static inline uint32 PolyBit(const uint32* table, uint32 pos) {
+    return (table[pos >> 5] >> (pos & 31)) & 1;
+}
+
+// Run each LFSR through one full period once and record its output bit.
+void PokeyPoly::BuildTables() {
+    uint32 poly4 = 0x0F, poly5 = 0x1F, poly9 = 0x1FF, poly17 = 0x1FFFF;
+
+    memset(Poly4Table, 0, sizeof(Poly4Table));
+    memset(Poly5Table, 0, sizeof(Poly5Table));
+    memset(Poly9Table, 0, sizeof(Poly9Table));
+    memset(Poly17Table, 0, sizeof(Poly17Table));
+
+    for (uint32 i = 0; i < POLY17_LEN; i++) {
+        uint32 bit17 = ((poly17 >> 16) ^ (poly17 >> 13)) & 1;
+        poly17 = ((poly17 << 1) | bit17) & 0x1FFFF;
+        Poly17Table[i >> 5] |= (poly17 & 1) << (i & 31);
+
+        if (i < POLY9_LEN) {
+            uint32 bit9 = ((poly9 >> 8) ^ (poly9 >> 4)) & 1;
+            poly9 = ((poly9 << 1) | bit9) & 0x1FF;
+            Poly9Table[i >> 5] |= (poly9 & 1) << (i & 31);
+        }
+        if (i < POLY5_LEN) {
+            uint32 bit5 = ((poly5 >> 4) ^ (poly5 >> 2)) & 1;
+            poly5 = ((poly5 << 1) | bit5) & 0x1F;
+            Poly5Table[0] |= (poly5 & 1) << i;
+        }
+        if (i < POLY4_LEN) {
+            uint32 bit4 = ((poly4 >> 3) ^ (poly4 >> 2)) & 1;
+            poly4 = ((poly4 << 1) | bit4) & 0x0F;
+            Poly4Table[0] |= (poly4 & 1) << i;
+        }
+    }
+
+    // Wrap the first 64 bits past the end for Random9/Random17.
+    for (uint32 i = 0; i < 64; i++) {
+        uint32 bit9 = PolyBit(Poly9Table, i);
+        uint32 bit17 = PolyBit(Poly17Table, i);
+        Poly9Table[(POLY9_LEN + i) >> 5] |= bit9 << ((POLY9_LEN + i) & 31);
+        Poly17Table[(POLY17_LEN + i) >> 5] |= bit17 << ((POLY17_LEN + i) & 31);
+    }
+    TablesBuilt = true;
+}
+
+void PokeyPoly::Reset() {
+    if (!TablesBuilt) {
+        BuildTables();
+    }
+    m_pos4 = 0;
+    m_pos5 = 0;
+    m_pos9 = 0;
+    m_pos17 = 0;
+}
+
+uint8 PokeyPoly::Next() {
+    uint8 state = (uint8)(PolyBit(Poly4Table, m_pos4)
+                | (PolyBit(Poly5Table, m_pos5) << 1)
+                | (PolyBit(Poly9Table, m_pos9) << 2)
+                | (PolyBit(Poly17Table, m_pos17) << 3));
+
+    if (++m_pos4 == POLY4_LEN) m_pos4 = 0;
+    if (++m_pos5 == POLY5_LEN) m_pos5 = 0;
+    if (++m_pos9 == POLY9_LEN) m_pos9 = 0;
+    if (++m_pos17 == POLY17_LEN) m_pos17 = 0;
+    return state;
+}
+
+static inline uint8 PolyByte(const uint32* table, uint32 pos) {
+    uint64 w = ((uint64)table[(pos >> 5) + 1] << 32) | table[pos >> 5];
+    return (uint8)(w >> (pos & 31));
+}
+
+uint8 PokeyPoly::Random17() const {
+    return PolyByte(Poly17Table, m_pos17);
+}
+
+uint8 PokeyPoly::Random9() const {
+    return PolyByte(Poly9Table, m_pos9);
+}
+
+uint8 PokeyPoly::Skip(uint32 ticks) {
+    uint32 skip = ticks - 1;
+    m_pos4  = (uint16)((m_pos4 + skip) % POLY4_LEN);
+    m_pos5  = (uint16)((m_pos5 + skip) % POLY5_LEN);
+    m_pos9  = (uint16)((m_pos9 + skip) % POLY9_LEN);
+    m_pos17 = (m_pos17 + skip) % POLY17_LEN;
+    return Next();
+}
+
 Pokey::Pokey() {
     Reset();
 }
@@ -27,10 +123,25 @@ void Pokey::Reset() {
     m_polyState = 0;
     m_postCounter = 0;
     
-    m_poly4 = 0x0F;
-    m_poly5 = 0x1F;
-    m_poly9 = 0x1FF;
-    m_poly17 = 0x1FFFF;
+    m_poly.Reset();
+    ResetReadRegisters();
+
+    m_audctl = 0;
+    m_timerEntry = 1;
+    memset(m_clockCounter, 0, sizeof(m_clockCounter));
+    memset(m_clockPeriod, 0, sizeof(m_clockPeriod));
+    memset(m_flip, 0, sizeof(m_flip));
+    memset(m_highPass, 0, sizeof(m_highPass));
+    m_renderKernel = &Pokey::RenderStandard;
+}
+
+// No paddles, keyboard or serial on the 7800: pots read as fully counted
+// ($E4), ALLPOT as done, and the active-low status registers as idle.
+void Pokey::ResetReadRegisters() {
+    memset(m_readRegs, 0xFF, sizeof(m_readRegs));
+    memset(m_readRegs, 0xE4, 8);   // POT0-7
+    m_readRegs[0x08] = 0x00;       // ALLPOT
+    m_readRegs[0x0A] = m_poly.Random17();
 }
 
 void Pokey::Write(uint8 addr, uint8 val) {
@@ -39,27 +150,251 @@ void Pokey::Write(uint8 addr, uint8 val) {
     
     if (addr < 8 && (addr & 1) == 0) {
         m_divisor[addr >> 1] = val;
+        if (m_audctl) {
+            UpdateClockPeriods();
+        }
+    } else if (addr == 8) { // AUDCTL
+        SetAudctl(val);
     } else if (addr == 9) { // STIMER
         for (int i = 0; i < 4; i++) {
             m_counter[i] = m_divisor[i];
         }
+        if (m_audctl) {
+            for (int i = 0; i < 4; i++) {
+                m_clockCounter[i] = (sint32)m_clockPeriod[i];
+            }
+        }
+    }
+}
+
+// AUDCTL selects the timer kernel once per write, so the AUDCTL=0 path
+// never tests the extended bits while rendering.
+void Pokey::SetAudctl(uint8 val) {
+    uint8 old = m_audctl;
+    m_audctl = val;
+
+    if (val && !old) {
+        // Carry the 8-bit tick counters over into clock counters.
+        for (int i = 0; i < 4; i++) {
+            m_clockCounter[i] = (sint32)((m_counter[i] + 1) * CLOCKS_PER_TICK);
+            m_flip[i] = m_output[i];
+        }
+        m_timerEntry = 9;
+        m_renderKernel = &Pokey::RenderAudctl;
+    } else if (!val && old) {
+        for (int i = 0; i < 4; i++) {
+            sint32 ticks = (m_clockCounter[i] + CLOCKS_PER_TICK - 1) / CLOCKS_PER_TICK;
+            m_counter[i] = (uint8)(ticks <= 0 ? 0 : (ticks > 256 ? 255 : ticks - 1));
+            m_output[i] = m_flip[i];
+        }
+        m_timerEntry = 1;
+        m_renderKernel = &Pokey::RenderStandard;
+    }
+
+    if (!(val & 0x04)) m_highPass[0] = 0;
+    if (!(val & 0x02)) m_highPass[1] = 0;
+    if (val) {
+        UpdateClockPeriods();
+    }
+}
+
+// Underflow period of one channel in 1.79 MHz clocks. Static so the IRQ
+// scheduler can use it on register values it tracks itself.
+uint32 Pokey::ClockPeriod(uint8 audctl, const uint8* divisor, int channel) {
+    uint32 base = (audctl & 0x01) ? CLOCKS_15KHZ : CLOCKS_PER_TICK;
+
+    switch (channel) {
+        // Channels 1 and 3 can run straight off 1.79 MHz (+4 clock reload).
+        case 0:
+            return (audctl & 0x40) ? divisor[0] + 4 : (divisor[0] + 1) * base;
+        case 2:
+            return (audctl & 0x20) ? divisor[2] + 4 : (divisor[2] + 1) * base;
+
+        // Joined pairs count 16 bits on the low channel's clock (+7 reload at 1.79 MHz).
+        case 1:
+            if (audctl & 0x10) {
+                uint32 div = ((uint32)divisor[1] << 8) | divisor[0];
+                return (audctl & 0x40) ? div + 7 : (div + 1) * base;
+            }
+            return (divisor[1] + 1) * base;
+        default:
+            if (audctl & 0x08) {
+                uint32 div = ((uint32)divisor[3] << 8) | divisor[2];
+                return (audctl & 0x20) ? div + 7 : (div + 1) * base;
+            }
+            return (divisor[3] + 1) * base;
+    }
+}
+
+void Pokey::UpdateClockPeriods() {
+    for (int i = 0; i < 4; i++) {
+        m_clockPeriod[i] = ClockPeriod(m_audctl, m_divisor, i);
+    }
+}
+
+// One 64 kHz tick of the AUDCTL kernel: run every divider in 1.79 MHz
+// clocks, then derive the outputs the mixer sees.
+void Pokey::StepAudctlTimers() {
+    if (m_audctl & 0x80) {
+        // 9-bit poly replaces the 17-bit one, RANDOM included.
+        m_polyState = (m_polyState & 0x07) | ((m_polyState & 0x04) << 1);
+        m_readRegs[0x0A] = m_poly.Random9();
+    }
+
+    uint8 underflow = 0;
+    uint8 volumeOnly = 0;
+    for (int i = 0; i < 4; i++) {
+        if (m_regs[i * 2 + 1] & 0x10) {
+            m_flip[i] = 1;
+            volumeOnly |= (uint8)(1 << i);
+            continue;
+        }
+        sint32 c = m_clockCounter[i] - CLOCKS_PER_TICK;
+        if (c <= 0) {
+            uint32 period = m_clockPeriod[i];
+            uint32 n = 1 + (uint32)(-c) / period;
+            c += (sint32)(n * period);
+            m_flip[i] ^= (uint8)(n & 1);
+            underflow |= (uint8)(1 << i);
+        }
+        m_clockCounter[i] = c;
     }
+
+    // High-pass: channel 3/4 underflow latches channel 1/2.
+    if ((m_audctl & 0x04) && (underflow & 0x04)) m_highPass[0] = m_flip[0];
+    if ((m_audctl & 0x02) && (underflow & 0x08)) m_highPass[1] = m_flip[1];
+
+    // The low half of a joined pair is muted; its divider only clocks the high half.
+    // Volume-only channels stay high, as on the AUDCTL=0 path, past both the
+    // high-pass latch and the muting (channel 4's flip is already forced).
+    m_output[0] = (uint8)(((m_audctl & 0x10) ? 0 : (m_flip[0] ^ m_highPass[0])) | (volumeOnly & 1));
+    m_output[1] = (uint8)((m_flip[1] ^ m_highPass[1]) | ((volumeOnly >> 1) & 1));
+    m_output[2] = (uint8)(((m_audctl & 0x08) ? 0 : m_flip[2]) | ((volumeOnly >> 2) & 1));
+    m_output[3] = m_flip[3];
 }
 
-void Pokey::UpdatePoly() {
-    uint32 bit4 = ((m_poly4 >> 3) ^ (m_poly4 >> 2)) & 1;
-    m_poly4 = ((m_poly4 << 1) | bit4) & 0x0F;
+// Full sample in one pass: same math as the nine TickStep() steps,
+// but without the per-call state machine.
+inline uint8 Pokey::RenderSample() {
+    UpdatePoly();
+    uint32 total = 0;
+
+    for (int i = 0; i < 4; i++) {
+        uint8 audc = m_regs[i * 2 + 1];
+        if (!(audc & 0x10)) {
+            if (m_counter[i] == 0) {
+                m_counter[i] = m_divisor[i];
+                m_output[i] ^= 1;
+            } else {
+                m_counter[i]--;
+            }
+        } else {
+            m_output[i] = 1;
+        }
+
+        if (m_output[i] && DistortionLUT[(audc >> 5) & 0x07][m_polyState]) {
+            total += (audc & 0x0F);
+        }
+    }
+
+    return (uint8)total;
+}
 
-    uint32 bit5 = ((m_poly5 >> 4) ^ (m_poly5 >> 2)) & 1;
-    m_poly5 = ((m_poly5 << 1) | bit5) & 0x1F;
+inline uint32 Pokey::MixChannels() const {
+    uint32 total = 0;
+    for (int i = 0; i < 4; i++) {
+        uint8 audc = m_regs[i * 2 + 1];
+        if (m_output[i] && DistortionLUT[(audc >> 5) & 0x07][m_polyState]) {
+            total += (audc & 0x0F);
+        }
+    }
+    return total;
+}
 
-    uint32 bit9 = ((m_poly9 >> 8) ^ (m_poly9 >> 4)) & 1;
-    m_poly9 = ((m_poly9 << 1) | bit9) & 0x1FF;
+void Pokey::Render(uint8* out, size_t count) {
+    // Finish a sample that TickStep() left half-done so both paths
+    // stay on the same timeline.
+    while (m_tickStep != 0) {
+        TickStep();
+    }
 
-    uint32 bit17 = ((m_poly17 >> 16) ^ (m_poly17 >> 13)) & 1;
-    m_poly17 = ((m_poly17 << 1) | bit17) & 0x1FFFF;
+    (this->*m_renderKernel)(out, count);
+    if (count) {
+        m_cachedOutput = out[count - 1];
+    }
+}
 
-    m_polyState = (m_poly4 & 1) | ((m_poly5 & 1) << 1) | ((m_poly9 & 1) << 2) | ((m_poly17 & 1) << 3);
+void Pokey::RenderAudctl(uint8* out, size_t count) {
+    for (size_t n = 0; n < count; n++) {
+        UpdatePoly();
+        StepAudctlTimers();
+        uint32 total = MixChannels();
+        out[n] = (uint8)total;
+    }
+}
+
+void Pokey::RenderStandard(uint8* out, size_t count) {
+    // Event-driven: a running channel with counter c only decrements for
+    // the next c ticks, so jump straight to the nearest toggle and render
+    // the span in between without stepping the timers.
+    size_t n = 0;
+    while (n < count) {
+        size_t remaining = count - n;
+        uint32 run = remaining > 0x10000 ? 0x10000 : (uint32)remaining;
+        for (int i = 0; i < 4; i++) {
+            if (!(m_regs[i * 2 + 1] & 0x10) && m_counter[i] < run) {
+                run = m_counter[i];
+            }
+        }
+
+        if (run == 0) {
+            // A channel toggles on this tick.
+            out[n++] = RenderSample();
+            continue;
+        }
+
+        // No edges for `run` ticks: split the mix into a constant part and
+        // the channels whose output still follows the poly counters.
+        uint32 fixedTotal = 0;
+        uint8 polyChannels = 0;
+        for (int i = 0; i < 4; i++) {
+            uint8 audc = m_regs[i * 2 + 1];
+            if (!(audc & 0x10)) {
+                m_counter[i] -= run;
+            } else {
+                m_output[i] = 1;
+            }
+            if (m_output[i] && (audc & 0x0F)) {
+                // Distortions 5 and 7 are pure tones (all-ones LUT rows).
+                if ((((audc >> 5) & 0x05) == 0x05)) {
+                    fixedTotal += (audc & 0x0F);
+                } else {
+                    polyChannels |= (uint8)(1 << i);
+                }
+            }
+        }
+
+        if (!polyChannels) {
+            SkipPoly(run);
+            memset(out + n, (uint8)fixedTotal, run);
+            n += run;
+            continue;
+        }
+
+        for (uint32 t = 0; t < run; t++) {
+            UpdatePoly();
+            uint32 total = fixedTotal;
+            for (int i = 0; i < 4; i++) {
+                if (polyChannels & (1 << i)) {
+                    uint8 audc = m_regs[i * 2 + 1];
+                    if (DistortionLUT[(audc >> 5) & 0x07][m_polyState]) {
+                        total += (audc & 0x0F);
+                    }
+                }
+            }
+            out[n++] = (uint8)total;
+        }
+    }
 }
 
 bool Pokey::TickStep() {
@@ -68,7 +403,7 @@ bool Pokey::TickStep() {
             UpdatePoly();
             m_tempTotal = 0;
 
-            m_tickStep = 1;
+            m_tickStep = m_timerEntry;
             break;
 
         case 1: case 2: case 3: case 4: {
@@ -99,14 +434,26 @@ bool Pokey::TickStep() {
             }
 
             if (m_tickStep == 8) {
-                // Done. Scale 0-60 to 0-255.
-                m_cachedOutput = (uint8)((m_tempTotal << 2) + (m_tempTotal >> 2));
+                // Done. Raw 0-60 sum; the output stage maps it (nonlinearly) to PWM.
+                m_cachedOutput = (uint8)m_tempTotal;
                 m_tickStep = 0;
                 return true; 
             }
             m_tickStep++;
             break;
         }
+
+        case 9:
+            // AUDCTL kernel: all four dividers in one step, then mix as usual.
+            StepAudctlTimers();
+            m_tickStep = 10;
+            break;
+
+        case 10: case 11: case 12:
+            // Idle steps so an AUDCTL sample also takes STEPS_PER_SAMPLE calls
+            // (the caller paces steps in fixed cycles; fewer would raise the pitch).
+            m_tickStep = (m_tickStep == 12) ? 5 : m_tickStep + 1;
+            break;
     }
     return false;
 }
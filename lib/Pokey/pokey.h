@@ -2,28 +2,94 @@
 #define POKEY_H
 
 #include "typedefs.h"
+#include <stddef.h>
+
+// Cursor into the precomputed poly4/poly5/poly9/poly17 sequences. The
+// bit-packed tables are built once and shared by every chip.
+class PokeyPoly {
+public:
+    void Reset();
+    uint8 Next();              // Current bits (1=poly4, 2=5, 4=9, 8=17), then advance
+    uint8 Skip(uint32 ticks);  // Same as `ticks` calls to Next() (ticks >= 1)
+    uint8 Random17() const;    // Next 8 bits of the 17-bit sequence (RANDOM)
+    uint8 Random9() const;     // Same from the 9-bit sequence (AUDCTL bit 7)
+
+private:
+    uint16 m_pos4;
+    uint16 m_pos5;
+    uint16 m_pos9;
+    uint32 m_pos17;
+
+    // Sequence lengths and bit-packed output tables (bit n = LFSR output
+    // after n+1 shifts from the all-ones reset state). The 9/17-bit tables
+    // repeat their first 64 bits past the end so RANDOM never wraps mid-read.
+    enum {
+        POLY4_LEN  = 15,
+        POLY5_LEN  = 31,
+        POLY9_LEN  = 511,
+        POLY17_LEN = 131071
+    };
+    static uint32 Poly4Table[1];
+    static uint32 Poly5Table[1];
+    static uint32 Poly9Table[(POLY9_LEN + 31) / 32 + 2];
+    static uint32 Poly17Table[(POLY17_LEN + 31) / 32 + 2];
+    static bool   TablesBuilt;
+    static void BuildTables();
+};
 
 class Pokey {
 public:
+    // Samples are the summed channel volumes (0..MAX_OUTPUT), not a
+    // voltage; the output stage applies the mixing curve.
+    enum {
+        MAX_OUTPUT = 60,
+        STEPS_PER_SAMPLE = 9   // TickStep() calls per output sample
+    };
+
     Pokey();
     void Reset();
     void Write(uint8 addr, uint8 val);
     bool TickStep();
+    void Render(uint8* out, size_t count);
     uint8 GetOutput() const { return m_cachedOutput; }
 
+    // Readable registers, refreshed every tick so a bus read is one load.
+    const uint8* ReadRegisters() const { return m_readRegs; }
+    uint8 Read(uint8 addr) const { return m_readRegs[addr & 0x0F]; }
+
+    // IRQST readback (active low); owned by the IRQ scheduler, which runs
+    // in bus time rather than synthesis time.
+    void SetIrqStatus(uint8 status) { m_readRegs[0x0E] = status; }
+
+    // Underflow period of `channel` in 1.79 MHz clocks for the given
+    // AUDCTL and AUDF1-4 values.
+    static uint32 ClockPeriod(uint8 audctl, const uint8* divisor, int channel);
+
+    enum {
+        CLOCKS_PER_TICK = 28,   // 1.79 MHz clocks per 64 kHz tick
+        CLOCKS_15KHZ    = 114   // 1.79 MHz clocks per 15 kHz tick
+    };
+
 private:
     uint8 m_regs[16];
+    uint8 m_readRegs[16];
     
     // Timer state
     uint8  m_counter[4];
     uint8  m_divisor[4];
     uint8  m_output[4];
-    
-    // Polynomial state (LFSRs)
-    uint32 m_poly4;
-    uint32 m_poly5;
-    uint32 m_poly9;
-    uint32 m_poly17;
+
+    // AUDCTL kernel state (only touched while AUDCTL != 0)
+    uint8  m_audctl;
+    uint8  m_timerEntry;        // First TickStep() timer step: 1 = standard, 9 = AUDCTL
+    sint32 m_clockCounter[4];   // 1.79 MHz clocks until next underflow
+    uint32 m_clockPeriod[4];    // Underflow period in 1.79 MHz clocks
+    uint8  m_flip[4];           // Raw divider flip-flops
+    uint8  m_highPass[2];       // High-pass latches for channels 1 and 2
+    void (Pokey::*m_renderKernel)(uint8* out, size_t count);
+
+    // Polynomial state
+    PokeyPoly m_poly;
     uint8  m_polyState; // Combined current bits (1=poly4, 2=5, 4=9, 8=17)
 
     uint8_t m_cachedOutput;
@@ -31,8 +97,24 @@ private:
     uint32_t m_tempTotal;
     uint32_t m_postCounter;  // Counter for 3-second POST chirp
 
-    void UpdatePoly();
+    void UpdatePoly() {
+        m_polyState = m_poly.Next();
+        m_readRegs[0x0A] = m_poly.Random17();
+    }
+    void SkipPoly(uint32 ticks) {
+        m_polyState = m_poly.Skip(ticks);
+        m_readRegs[0x0A] = m_poly.Random17();
+    }
+    void ResetReadRegisters();
+    uint8 RenderSample();
+    uint32 MixChannels() const;
+    void RenderStandard(uint8* out, size_t count);
+    void RenderAudctl(uint8* out, size_t count);
+    void SetAudctl(uint8 val);
+    void UpdateClockPeriods();
+    void StepAudctlTimers();
     static const uint8_t DistortionLUT[8][16];
+    friend class DualPokey;
 };
 
 #endif // POKEY_H
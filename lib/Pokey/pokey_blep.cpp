@@ -0,0 +1,107 @@
+#include "pokey_blep.h"
+#include <string.h>
+#include <math.h>
+
+sint16 PokeyBlep::Kernel[PHASES][KERNEL_WIDTH];
+bool   PokeyBlep::KernelBuilt = false;
+
+// Tap k of phase p is the rise of a Blackman-windowed sinc step between
+// output samples k-1 and k, for a step landing p/PHASES into sample 0.
+// Each phase sums to exactly 1 << KERNEL_SHIFT so the integrator never drifts.
+void PokeyBlep::BuildKernel() {
+    const double cutoff = 0.45;  // Fraction of the output rate
+    const double center = KERNEL_WIDTH / 2.0;
+    const int    sub = 32;       // Integration points per tap
+
+    for (int p = 0; p < PHASES; p++) {
+        double frac = (double)p / PHASES;
+        sint32 sum = 0;
+        int peak = 0;
+
+        for (int k = 0; k < KERNEL_WIDTH; k++) {
+            double area = 0.0;
+            for (int s = 0; s < sub; s++) {
+                double x = (k - 1) - frac + (s + 0.5) / sub;  // Time since the step
+                if (x <= 0.0 || x >= KERNEL_WIDTH) {
+                    continue;
+                }
+                double t = x - center;
+                double sinc = (t == 0.0) ? 1.0 : sin(2.0 * M_PI * cutoff * t) / (2.0 * M_PI * cutoff * t);
+                double w = 0.42 - 0.5 * cos(2.0 * M_PI * x / KERNEL_WIDTH)
+                                + 0.08 * cos(4.0 * M_PI * x / KERNEL_WIDTH);
+                area += 2.0 * cutoff * sinc * w / sub;
+            }
+            Kernel[p][k] = (sint16)lround(area * (1 << KERNEL_SHIFT));
+            sum += Kernel[p][k];
+            if (Kernel[p][k] > Kernel[p][peak]) {
+                peak = k;
+            }
+        }
+        Kernel[p][peak] += (sint16)((1 << KERNEL_SHIFT) - sum);
+    }
+    KernelBuilt = true;
+}
+
+PokeyBlep::PokeyBlep() {
+    SetOutputRate(TICK_RATE / 2);
+    Reset();
+}
+
+void PokeyBlep::Reset() {
+    memset(m_accum, 0, sizeof(m_accum));
+    m_integrator = 0;
+    m_time = 0;
+    m_level = 0;
+}
+
+void PokeyBlep::SetOutputRate(uint32 sampleRate) {
+    if (sampleRate > TICK_RATE) {
+        sampleRate = TICK_RATE;
+    }
+    m_step = (uint32)(((uint64)sampleRate << 16) / TICK_RATE);
+}
+
+inline void PokeyBlep::AddStep(uint32 time, sint32 delta) {
+    const sint16* taps = Kernel[(time >> (16 - PHASE_BITS)) & (PHASES - 1)];
+    sint32* acc = &m_accum[time >> 16];
+    for (int k = 0; k < KERNEL_WIDTH; k++) {
+        acc[k] += delta * taps[k];
+    }
+}
+
+void PokeyBlep::Render(Pokey& pokey, uint8* out, size_t count) {
+    if (!KernelBuilt) {
+        BuildKernel();
+    }
+    if (count > MAX_BLOCK) {
+        count = MAX_BLOCK;
+    }
+
+    // Pull ticks until every step that can reach sample count-1 is in.
+    uint8 ticks[256];
+    uint32 end = (uint32)count << 16;
+    while (m_time < end) {
+        uint32 need = (end - m_time + m_step - 1) / m_step;
+        uint32 chunk = need > sizeof(ticks) ? (uint32)sizeof(ticks) : need;
+        pokey.Render(ticks, chunk);
+
+        for (uint32 t = 0; t < chunk; t++) {
+            if (ticks[t] != m_level) {
+                AddStep(m_time, (sint32)ticks[t] - m_level);
+                m_level = ticks[t];
+            }
+            m_time += m_step;
+        }
+    }
+
+    for (size_t n = 0; n < count; n++) {
+        m_integrator += m_accum[n];
+        sint32 s = (m_integrator + (1 << (KERNEL_SHIFT - 1))) >> KERNEL_SHIFT;
+        out[n] = (uint8)(s < 0 ? 0 : (s > Pokey::MAX_OUTPUT ? Pokey::MAX_OUTPUT : s));
+    }
+
+    // Only the kernel tail past `count` is live.
+    memmove(m_accum, m_accum + count, KERNEL_WIDTH * sizeof(sint32));
+    memset(m_accum + KERNEL_WIDTH, 0, count * sizeof(sint32));
+    m_time -= end;
+}
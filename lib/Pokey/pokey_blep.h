@@ -0,0 +1,53 @@
+#ifndef POKEY_BLEP_H
+#define POKEY_BLEP_H
+
+#include "typedefs.h"
+#include "pokey.h"
+#include <stddef.h>
+
+// Band-limited step synthesis for the POKEY output.
+//
+// Pokey renders at its 64 kHz tick rate; every change in the mixed level is
+// added here as a band-limited step (windowed-sinc BLEP) at its exact
+// fractional position in the output stream, and the result is integrated
+// out at a fixed, lower output rate. Aliasing from the square/noise edges
+// is filtered instead of folded back, and only level changes cost work.
+// The kernel table is built by the first Render(), not at construction, so
+// a static PokeyBlep costs no floating point before main().
+class PokeyBlep {
+public:
+    enum {
+        MAX_BLOCK    = 512,  // Max samples per Render() call
+        KERNEL_WIDTH = 16,   // Output samples touched by one step
+        PHASE_BITS   = 5,    // 32 sub-sample positions
+        PHASES       = 1 << PHASE_BITS,
+        KERNEL_SHIFT = 15    // Kernel taps are 1.15 fixed point
+    };
+
+    // POKEY 64 kHz tick rate (1789772.5 / 28).
+    static const uint32 TICK_RATE = 63920;
+
+    PokeyBlep();
+    void Reset();
+    void SetOutputRate(uint32 sampleRate);
+
+    // Render `count` (<= MAX_BLOCK) output samples, pulling as many ticks
+    // from `pokey` as they span. Output uses the same 0..MAX_OUTPUT scale
+    // as Pokey::Render(); the signal is delayed by KERNEL_WIDTH / 2 samples.
+    void Render(Pokey& pokey, uint8* out, size_t count);
+
+private:
+    sint32 m_accum[MAX_BLOCK + KERNEL_WIDTH];
+    sint32 m_integrator;
+    uint32 m_time;       // Next tick position, 16.16 output samples
+    uint32 m_step;       // Output samples per tick, 16.16
+    uint8  m_level;      // Last tick level seen
+
+    void AddStep(uint32 time, sint32 delta);
+
+    static sint16 Kernel[PHASES][KERNEL_WIDTH];
+    static bool   KernelBuilt;
+    static void BuildKernel();
+};
+
+#endif // POKEY_BLEP_H
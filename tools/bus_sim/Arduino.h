@@ -0,0 +1,17 @@
+#ifndef BUS_SIM_ARDUINO_H
+#define BUS_SIM_ARDUINO_H
+
+// Just enough of the Teensy core for the headers the bus engine pulls in
+// (audio_pwm.h, game_rom.h) to compile on the host. Hardware access itself
+// goes through bus_hal.h -> host_gpio.h.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef F_CPU
+#define F_CPU 816000000UL
+#endif
+
+#define FASTRUN
+
+#endif // BUS_SIM_ARDUINO_H
@@ -0,0 +1,1458 @@
+// Host bus-replay simulator: runs the real bus engine (include/bus_engine.h)
+// against the GPIO model in host_gpio.h.
+//
+// Build from the repository root:
+//   g++ -O2 -std=gnu++14 -DBUS_SIM -Itools/bus_sim -Iinclude -Ilib/Pokey
+//       tools/bus_sim/bus_sim.cpp lib/Pokey/*.cpp -o bus_sim
+// Add -DPOKEY_STEREO to simulate the dual-POKEY build, -DBUS_STATS to print
+// the loop latency histograms (bus_stats.h) after the run, -DBUS_PHI2_LOCK to
+// run the phase-locked engine.
+//
+// Usage:
+//   bus_sim [options] trace.txt      replay a -DBUS_TRACE dump
+//   bus_sim [options] --synthetic N  N generated bus cycles
+//   bus_sim [--rom game.a78 | --mapper name] --check-map
+//                                    walk all 64K addresses through the page
+//                                    table and compare with the plain decode
+//   bus_sim [options] [--rom game.a78 | --mapper name] --check-banks N
+//                                    N bus cycles of bank switches and
+//                                    window/fixed-bank fetches (CPU and
+//                                    MARIA); every byte the engine serves is
+//                                    checked against the bank it should show
+//                                    (default ROM: a generated SuperGame image)
+//   bus_sim [options] [--rom game.a78 | --mapper name] --check-ram N
+//                                    N bus cycles of cart RAM stores, loads,
+//                                    read-modify-writes and MARIA reads at
+//                                    $4000-$7FFF between ROM fetches; every
+//                                    read must return the last byte written
+//                                    (default ROM: a generated SuperGame
+//                                    image with RAM). With -DBUS_STATS the
+//                                    "ram" histogram against "drive" is the
+//                                    latency the RAM branch adds
+//   bus_sim [options] [--rom game.a78] --check-pokey-writes N
+//                                    N bus cycles of POKEY writes separated
+//                                    by ROM fetches, MARIA bursts, POKEY reads,
+//                                    RAM writes or nothing; every write must be
+//                                    committed once, in order, with its value
+//                                    and a timestamp inside its own bus cycle
+//   bus_sim [options] [--rom game.a78] --check-pokey-reads N
+//                                    N bus cycles of reads of every POKEY
+//                                    register (after fetches, MARIA bursts,
+//                                    stores, or back to back); each must find
+//                                    its register's byte on the bus 50 ns
+//                                    before the cycle ends. Prints the latency
+//   bus_sim [options] [--rom game.a78] --check-irq N
+//                                    program timers 1, 2 and 4 (several AUDCTL
+//                                    clocks), STIMER, and acknowledge N IRQs
+//                                    each from a wait loop; every IRQ must
+//                                    rise one period after the last (no drift)
+//                                    and drop on its IRQEN acknowledge
+//   bus_sim --check-queue N          N writes through PokeyWriteQueue from a
+//                                    simulated producer (restaging, commits)
+//                                    to a consumer that lags and stalls; each
+//                                    must arrive once, in order, when due, or
+//                                    be counted as an overflow
+//   bus_sim --check-header           decode a corpus of generated .a78 headers
+//                                    (a78_header.h) and compare each config
+//                                    with the expected one
+//   bus_sim --rom game.a78 --check-load
+//                                    load the image through a78_loader.h (as
+//                                    the firmware does from SD), print its
+//                                    config, compare it with the file and
+//                                    check that damaged copies are rejected
+//
+// Options:
+//   --rom game.a78   ROM to serve (default: the built-in game_rom.h image);
+//                    its header (a78_header.h) picks the mapper and POKEY address
+//   --mapper name    flat-ram, supergame, supergame-144k (nine banks),
+//                    supergame-exrom (cart type bit 3), supergame-bank6
+//                    (bit 4, 16 banks), supergame-ram, absolute or
+//                    activision: serve a generated image for that mapper
+//   --log file       event log ("-" for stdout), one line per event:
+//                      D cycle addr data   byte the engine held at the end of a read
+//                      D cycle addr --     cart read left undriven
+//                      X cycle addr data   engine driving during a CPU write
+//                      W cycle reg value   POKEY write committed by the sniffer
+//                      A|R cycle compare   PWM compare load (left/right)
+//                      I cycle 0|1         IRQ line change
+//   --access N       DWT cycles charged per GPIO read (default 6)
+//   --settle N       address lines lag each state by N cycles (default 0)
+//
+// Trace lines are "ADDR R|W HALT DELTA [DATA]" as printed by BusTrace::dump();
+// DELTA is DWT cycles since the previous line and DATA (hex) is the byte for
+// a CPU write, which the capture itself does not record (0 if absent).
+
+#include "bus_engine.h"
+#include "a78_loader.h"
+
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+HostBus hostBus;
+
+// DWT cycles per 1.79 MHz bus cycle.
+static const uint32_t BUS_CYCLE = (F_CPU + 895000) / 1790000;
+
+// Images served instead of the built-in one.
+static std::vector<uint8_t> romImage;
+
+// a78_loader.h sources: a stdio file, or bytes in memory.
+struct StdioSource {
+    FILE *file;
+    size_t read(uint8_t *dst, size_t n) { return fread(dst, 1, n, file); }
+};
+
+struct MemorySource {
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+
+    size_t read(uint8_t *dst, size_t n) {
+        if (n > size - pos) n = size - pos;
+        memcpy(dst, data + pos, n);
+        pos += n;
+        return n;
+    }
+};
+
+// Through the same loader as the firmware's SD boot (sd_rom.h).
+static A78Status loadRom(const char *path, A78Image &image) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return A78_NO_FILE;
+    StdioSource src = {f};
+    romImage.resize(ROM_WORDS_MAX);
+    A78Status status = loadA78(src, romImage.data(), ROM_WORDS_MAX, image);
+    fclose(f);
+    if (status != A78_OK) return status;
+
+    romImage.resize(image.config.romSize);
+    cartRom = romImage.data();
+    cartRomSize = image.config.romSize;
+    cartConfig = image.config;
+    return A78_OK;
+}
+
+// Generated images keep POKEY at $0450, where synthesize() writes it.
+static void setCartType(uint16_t cartType) {
+    cartConfig = cartConfigFor(cartType | CART_TYPE_POKEY_450, cartRomSize);
+}
+
+// Banks in the generated image, 0: the mapper's usual size.
+static uint32_t testRomBanks = 0;
+
+// An image for the cart type (`fallback` if that is plain flat) whose bytes
+// differ between banks at every offset.
+static void makeTestRom(uint16_t fallback) {
+    if (cartConfig.mapper == MAPPER_FLAT) setCartType(fallback);
+    CartMapper mapper = cartConfig.mapper;
+    uint32_t banks = mapper == MAPPER_ABSOLUTE ? 4 : mapper == MAPPER_FLAT_RAM ? 3 : 8;
+    if (testRomBanks) banks = testRomBanks;
+    romImage.resize(banks << 14);
+    for (uint32_t i = 0; i < romImage.size(); i++) {
+        romImage[i] = (uint8_t)(i * 131 + (i >> 8) + (i >> 14) * 29);
+    }
+    cartRom = romImage.data();
+    cartRomSize = (uint32_t)romImage.size();
+    cartConfig = cartConfigFor(cartConfig.cartType, cartRomSize);
+}
+
+// A loaded image against the raw file, then copies with a broken
+// signature, a zero size, a short header, a missing last byte and a
+// buffer one byte too small, each of which must be rejected.
+static int checkLoad(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "check-load: cannot open %s\n", path);
+        return 1;
+    }
+    std::vector<uint8_t> file;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) file.insert(file.end(), chunk, chunk + n);
+    fclose(f);
+
+    A78Image image;
+    auto t0 = std::chrono::steady_clock::now();
+    A78Status status = loadRom(path, image);
+    auto t1 = std::chrono::steady_clock::now();
+    double us = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / 1e3;
+    if (status != A78_OK) {
+        fprintf(stderr, "check-load: %s: %s\n", path, a78StatusName(status));
+        return 1;
+    }
+
+    uint32_t errors = 0;
+    uint32_t romSize = image.config.romSize;
+    for (uint32_t i = 0; i < romSize; i++) {
+        if (A78_HEADER_SIZE + i >= file.size() || romImage[i] != file[A78_HEADER_SIZE + i]) errors++;
+    }
+
+    struct Damage {
+        const char *name;
+        size_t size;         // Bytes of the file offered
+        int byte;            // Header byte to change; -1 none, -2 zero size, -3 huge size
+        uint8_t value;
+        uint32_t capacity;
+        A78Status expect;
+    };
+    const Damage damage[] = {
+        {"signature", file.size(), 1, 'X', ROM_WORDS_MAX, A78_BAD_HEADER},
+        {"zero size", file.size(), -2, 0, ROM_WORDS_MAX, A78_BAD_HEADER},
+        {"short header", 100, -1, 0, ROM_WORDS_MAX, A78_SHORT_READ},
+        {"truncated", A78_HEADER_SIZE + romSize - 1, -1, 0, ROM_WORDS_MAX, A78_SHORT_READ},
+        {"over limit", file.size(), -1, 0, romSize - 1, A78_OVER_LIMIT},
+        {"too large", file.size(), -3, 0, ROM_WORDS_MAX, A78_TOO_LARGE},
+    };
+    uint32_t rejected = 0;
+    std::vector<uint8_t> buffer(ROM_WORDS_MAX);
+    for (const Damage &d : damage) {
+        std::vector<uint8_t> copy(file.begin(), file.begin() + (d.size < file.size() ? d.size : file.size()));
+        if (d.byte >= 0) copy[d.byte] = d.value;
+        if (d.byte == -2) copy[49] = copy[50] = copy[51] = copy[52] = 0;
+        if (d.byte == -3) copy[50] = 0x10; // 1M and up
+        MemorySource src = {copy.data(), copy.size(), 0};
+        A78Image dummy;
+        A78Status got = loadA78(src, buffer.data(), d.capacity, dummy);
+        if (got == d.expect) {
+            rejected++;
+        } else {
+            fprintf(stderr, "check-load: %s: expected %s, got %s\n", d.name,
+                    a78StatusName(d.expect), a78StatusName(got));
+        }
+    }
+    uint32_t cases = sizeof(damage) / sizeof(damage[0]);
+
+    const CartConfig &c = image.config;
+    fprintf(stderr, "check-load: %u bytes, cart type 0x%04X (%s, POKEY at $%04X, %s%s), %u reads of up to %u, %.0f us, %u mismatches, %u of %u damaged copies rejected\n",
+            romSize, c.cartType, cartMapperName(c.mapper), c.pokeyAddr, c.pal ? "PAL" : "NTSC",
+            c.hsc ? ", HSC" : "", image.reads, A78_READ_CHUNK, us, errors, rejected, cases);
+    return (errors || rejected != cases) ? 1 : 0;
+}
+
+// parseA78Header() over a corpus of generated headers: every cart type
+// bit the firmware acts on, the POKEY locations, TV and save-device bytes,
+// and headers it must reject.
+static int checkHeader() {
+    struct Case {
+        const char *name;
+        uint16_t cartType;
+        uint32_t size;
+        uint8_t tv;          // Byte 57
+        uint8_t save;        // Byte 58
+        bool badSignature;
+        A78Status status;
+        CartMapper mapper;
+        CartRom4000 rom4000;
+        uint16_t pokeyAddr;
+        bool pal;
+        bool hsc;
+    };
+    const Case corpus[] = {
+        {"flat 48K",           0x0000, 0xC000,  0, 0, false, A78_OK, MAPPER_FLAT, ROM_4000_SECOND_LAST, 0, false, false},
+        {"flat 32K",           0x0000, 0x8000,  0, 0, false, A78_OK, MAPPER_FLAT, ROM_4000_SECOND_LAST, 0, false, false},
+        {"POKEY $450",         0x0040, 0xC000,  0, 0, false, A78_OK, MAPPER_FLAT, ROM_4000_SECOND_LAST, 0x0450, false, false},
+        {"POKEY $440",         0x0400, 0xC000,  0, 0, false, A78_OK, MAPPER_FLAT, ROM_4000_SECOND_LAST, 0x0440, false, false},
+        {"POKEY $440+$450",    0x0440, 0xC000,  0, 0, false, A78_OK, MAPPER_FLAT, ROM_4000_SECOND_LAST, 0x0440, false, false},
+        {"POKEY $800",         0x8000, 0xC000,  0, 0, false, A78_OK, MAPPER_FLAT, ROM_4000_SECOND_LAST, 0x0800, false, false},
+        {"POKEY $4000",        0x0001, 0x8000,  0, 0, false, A78_OK, MAPPER_FLAT, ROM_4000_SECOND_LAST, 0x4000, false, false},
+        {"flat RAM",           0x0004, 0x8000,  0, 0, false, A78_OK, MAPPER_FLAT_RAM, ROM_4000_SECOND_LAST, 0, false, false},
+        {"SuperGame",          0x0002, 0x20000, 0, 0, false, A78_OK, MAPPER_SUPERGAME, ROM_4000_SECOND_LAST, 0, false, false},
+        {"SuperGame POKEY",    0x0042, 0x20000, 0, 0, false, A78_OK, MAPPER_SUPERGAME, ROM_4000_SECOND_LAST, 0x0450, false, false},
+        {"SuperGame RAM",      0x0006, 0x20000, 0, 0, false, A78_OK, MAPPER_SUPERGAME_RAM, ROM_4000_SECOND_LAST, 0, false, false},
+        {"SuperGame 512K",     0x0002, 0x80000, 0, 0, false, A78_OK, MAPPER_SUPERGAME, ROM_4000_SECOND_LAST, 0, false, false},
+        {"SuperGame 144K",     0x0002, 0x24000, 0, 0, false, A78_OK, MAPPER_SUPERGAME, ROM_4000_FIRST, 0, false, false},
+        {"ROM at $4000",       0x000A, 0x24000, 0, 0, false, A78_OK, MAPPER_SUPERGAME, ROM_4000_FIRST, 0, false, false},
+        {"ROM at $4000 256K",  0x000A, 0x40000, 0, 0, false, A78_OK, MAPPER_SUPERGAME, ROM_4000_FIRST, 0, false, false},
+        {"bank 6 at $4000",    0x0012, 0x40000, 0, 0, false, A78_OK, MAPPER_SUPERGAME, ROM_4000_BANK6, 0, false, false},
+        {"bank 6 of six",      0x0012, 0x18000, 0, 0, false, A78_UNSUPPORTED, MAPPER_FLAT, ROM_4000_SECOND_LAST, 0, false, false},
+        {"RAM and ROM $4000",  0x000E, 0x20000, 0, 0, false, A78_UNSUPPORTED, MAPPER_FLAT, ROM_4000_SECOND_LAST, 0, false, false},
+        {"banked RAM",         0x0022, 0x20000, 0, 0, false, A78_UNSUPPORTED, MAPPER_FLAT, ROM_4000_SECOND_LAST, 0, false, false},
+        {"mirror RAM",         0x0082, 0x20000, 0, 0, false, A78_UNSUPPORTED, MAPPER_FLAT, ROM_4000_SECOND_LAST, 0, false, false},
+        {"flat ROM at $4000",  0x0008, 0xC000,  0, 0, false, A78_OK, MAPPER_FLAT, ROM_4000_SECOND_LAST, 0, false, false},
+        {"Absolute",           0x0200, 0x10000, 0, 0, false, A78_OK, MAPPER_ABSOLUTE, ROM_4000_SECOND_LAST, 0, false, false},
+        {"Absolute RAM bit",   0x0204, 0x10000, 0, 0, false, A78_OK, MAPPER_ABSOLUTE, ROM_4000_SECOND_LAST, 0, false, false},
+        {"Activision",         0x0100, 0x20000, 0, 0, false, A78_OK, MAPPER_ACTIVISION, ROM_4000_SECOND_LAST, 0, false, false},
+        {"Souper (flat)",      0x1000, 0x20000, 0, 0, false, A78_OK, MAPPER_FLAT, ROM_4000_SECOND_LAST, 0, false, false},
+        {"PAL",                0x0000, 0xC000,  1, 0, false, A78_OK, MAPPER_FLAT, ROM_4000_SECOND_LAST, 0, true, false},
+        {"NTSC componentized", 0x0000, 0xC000,  2, 0, false, A78_OK, MAPPER_FLAT, ROM_4000_SECOND_LAST, 0, false, false},
+        {"HSC",                0x0000, 0xC000,  0, 1, false, A78_OK, MAPPER_FLAT, ROM_4000_SECOND_LAST, 0, false, true},
+        {"SaveKey only",       0x0000, 0xC000,  0, 2, false, A78_OK, MAPPER_FLAT, ROM_4000_SECOND_LAST, 0, false, false},
+        {"bad signature",      0x0000, 0xC000,  0, 0, true,  A78_BAD_HEADER, MAPPER_FLAT, ROM_4000_SECOND_LAST, 0, false, false},
+        {"zero size",          0x0002, 0,       0, 0, false, A78_BAD_HEADER, MAPPER_FLAT, ROM_4000_SECOND_LAST, 0, false, false},
+    };
+
+    uint32_t errors = 0;
+    uint32_t cases = sizeof(corpus) / sizeof(corpus[0]);
+    for (const Case &c : corpus) {
+        uint8_t header[A78_HEADER_SIZE] = {3};
+        memcpy(header + 1, c.badSignature ? "ATARI7900" : "ATARI7800", 9);
+        header[49] = (uint8_t)(c.size >> 24);
+        header[50] = (uint8_t)(c.size >> 16);
+        header[51] = (uint8_t)(c.size >> 8);
+        header[52] = (uint8_t)c.size;
+        header[53] = (uint8_t)(c.cartType >> 8);
+        header[54] = (uint8_t)c.cartType;
+        header[57] = c.tv;
+        header[58] = c.save;
+
+        CartConfig config = cartConfigFor(0, 0);
+        A78Status status = parseA78Header(header, config);
+        bool ok = status == c.status;
+        if (ok && status == A78_OK) {
+            ok = config.romSize == c.size && config.cartType == c.cartType && config.mapper == c.mapper
+                 && config.rom4000 == c.rom4000 && config.pokeyAddr == c.pokeyAddr && config.pal == c.pal && config.hsc == c.hsc;
+        }
+        if (!ok) {
+            errors++;
+            fprintf(stderr, "check-header: %s: %s, %s, $4000 layout %d, POKEY at $%04X, %s%s\n", c.name,
+                    a78StatusName(status), cartMapperName(config.mapper), (int)config.rom4000, config.pokeyAddr,
+                    config.pal ? "PAL" : "NTSC", config.hsc ? ", HSC" : "");
+        }
+    }
+
+    fprintf(stderr, "check-header: built-in image: cart type 0x%04X (%s), POKEY at $%04X, %s\n",
+            cartConfig.cartType, cartMapperName(cartConfig.mapper), cartConfig.pokeyAddr,
+            cartConfig.pal ? "PAL" : "NTSC");
+    fprintf(stderr, "check-header: %u headers, %u mismatches\n", cases, errors);
+    return errors ? 1 : 0;
+}
+
+static bool hasCartRam(CartMapper mapper) {
+    return mapper == MAPPER_FLAT_RAM || mapper == MAPPER_SUPERGAME_RAM;
+}
+
+// The ROM layout under the cart RAM.
+static CartMapper romMapper(CartMapper mapper) {
+    switch (mapper) {
+    case MAPPER_FLAT_RAM:      return MAPPER_FLAT;
+    case MAPPER_SUPERGAME_RAM: return MAPPER_SUPERGAME;
+    default:                   return mapper;
+    }
+}
+
+// First address of the switched window.
+static uint32_t bankWindow(CartMapper mapper) {
+    switch (romMapper(mapper)) {
+    case MAPPER_ABSOLUTE:   return 0x4000;
+    case MAPPER_ACTIVISION: return 0xA000;
+    default:                return 0x8000;
+    }
+}
+
+// POKEY takes its whole page over whatever the mapper puts there.
+static bool inPokeyPage(uint32_t addr) {
+    return cartConfig.pokeyAddr && (addr >> 8) == (uint32_t)(cartConfig.pokeyAddr >> 8);
+}
+
+// Cart RAM as the engine serves it: $4000-$7FFF less a POKEY page.
+static bool inCartRam(uint32_t addr) {
+    return addr >= 0x4000 && addr < 0x8000 && !inPokeyPage(addr);
+}
+
+// Expected byte of a POKEY register read in a mixed stream: driven from
+// the register file, whose values --check-pokey-reads checks.
+#define EXPECT_POKEY -2
+
+// The cart as a plain decode of the mapper's documented layout sees it:
+// the ROM byte at `addr` with `bank` in the window, or -1 where the cart
+// does not drive ROM.
+static int referenceByte(uint32_t addr, uint32_t bank) {
+    uint32_t banks = cartRomSize >> 14;
+    if (inPokeyPage(addr)) return -1;
+    if (hasCartRam(cartMapper) && addr >= 0x4000 && addr < 0x8000) return -1;
+    switch (romMapper(cartMapper)) {
+    case MAPPER_SUPERGAME: {
+        // .a78 SuperGame: the last bank at $C000. At $4000 the second-to-last
+        // bank, or bank 6 with cart type bit 4. Bit 3, and every 144K image,
+        // adds an extra first bank at $4000 ahead of the switched ones: a
+        // write of n then shows bank n + 1.
+        uint16_t type = cartConfig.cartType;
+        bool extra = (type & CART_TYPE_ROM_4000) || (!(type & CART_TYPE_BANK6_4000) && banks == 9);
+        uint32_t first = extra ? 1 : 0;
+        uint32_t low = extra ? 0 : (type & CART_TYPE_BANK6_4000) ? 6 : banks - 2;
+        if (addr >= 0xC000) return cartRom[((banks - 1) << 14) + (addr - 0xC000)];
+        if (addr >= 0x8000) return cartRom[((first + bank % (banks - first)) << 14) + (addr - 0x8000)];
+        if (addr >= 0x4000) return cartRom[(low << 14) + (addr - 0x4000)];
+        return -1;
+    }
+    case MAPPER_ABSOLUTE:
+        if (addr >= 0x8000) return cartRom[cartRomSize - 0x10000 + addr];
+        if (addr >= 0x4000) return cartRom[(bank << 14) + (addr - 0x4000)];
+        return -1;
+    case MAPPER_ACTIVISION:
+        if (addr >= 0xE000) return cartRom[7 * 0x4000 + (addr - 0xE000)];
+        if (addr >= 0xA000) return cartRom[bank * 0x4000 + (addr - 0xA000)];
+        if (addr >= 0x8000) return cartRom[7 * 0x4000 + 0x2000 + (addr - 0x8000)];
+        if (addr >= 0x6000) return cartRom[6 * 0x4000 + (addr - 0x6000)];
+        if (addr >= 0x4000) return cartRom[6 * 0x4000 + 0x2000 + (addr - 0x4000)];
+        return -1;
+    default: {
+        uint32_t size = cartRomSize < 0xC000 ? cartRomSize : 0xC000;
+        return addr >= 0x10000 - size ? cartRom[addr - (0x10000 - size)] : -1;
+    }
+    }
+}
+
+// The bank a CPU write leaves in the window, per the mapper's documentation.
+static uint32_t referenceBank(uint32_t addr, uint8_t value, uint32_t bank) {
+    switch (romMapper(cartMapper)) {
+    case MAPPER_SUPERGAME:
+        return value;
+    case MAPPER_ABSOLUTE:
+        if (addr != 0x8000) return bank;
+        return (value & 1) ? 0 : (value & 2) ? 1 : bank;
+    case MAPPER_ACTIVISION:
+        return (addr >= 0xFF80 && addr <= 0xFF8F) ? (addr & 7) : bank;
+    default:
+        return bank;
+    }
+}
+
+// The byte the page table (and the current bank) puts behind `addr`, or -1.
+static int servedByte(uint32_t addr) {
+    const PageEntry &page = PAGE_TABLE[addr >> 8];
+    RomCell cell;
+    if (page.kind == PAGE_ROM || page.kind == PAGE_SWITCH) {
+        cell = page.base[addr & 0xFF];
+    } else if (page.kind == PAGE_BANK) {
+        switch (romMapper(cartMapper)) {
+        case MAPPER_SUPERGAME:  cell = SuperGameMapper::bankCell(addr); break;
+        case MAPPER_ABSOLUTE:   cell = AbsoluteMapper::bankCell(addr); break;
+        case MAPPER_ACTIVISION: cell = ActivisionMapper::bankCell(addr); break;
+        default:                return -1;
+        }
+    } else {
+        return -1;
+    }
+    return (uint8_t)(cell >> (sizeof(RomCell) > 1 ? 16 : 0));
+}
+
+static bool loadTrace(const char *path, std::vector<BusState> &out) {
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+
+    // Each line carries the delta since the previous one, so a state's
+    // duration is the next line's delta.
+    std::vector<uint32_t> deltas;
+    char line[128];
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#' || line[0] == '\n') continue;
+        unsigned addr, halt, delta, data = 0;
+        char rw;
+        char extra[16] = "";
+        if (sscanf(line, "%x %c %u %u %15s", &addr, &rw, &halt, &delta, extra) < 4) continue;
+        if (extra[0] && extra[0] != '*') data = (unsigned)strtoul(extra, NULL, 16);
+
+        BusState s = {(uint16_t)addr, (uint8_t)data, rw == 'R', halt != 0, BUS_CYCLE};
+        out.push_back(s);
+        deltas.push_back(delta ? delta : 1);
+    }
+    fclose(f);
+
+    for (size_t i = 0; i + 1 < out.size(); i++) {
+        out[i].cycles = deltas[i + 1];
+    }
+    return !out.empty();
+}
+
+// CPU fetching ROM with periodic RAM traffic, POKEY writes (tone, AUDCTL,
+// IRQEN, STIMER) and RANDOM reads at the cart's POKEY address, and a MARIA
+// DMA burst every 1024 cycles.
+static void synthesize(uint32_t count, std::vector<BusState> &out) {
+    static const uint8_t regs[] = {0x00, 0x01, 0x02, 0x03, 0x08, 0x0E, 0x09};
+    uint16_t pokeyAddr = cartConfig.pokeyAddr ? cartConfig.pokeyAddr : POKEY_BASE_ADDR;
+    uint16_t pc = 0x8000;
+
+    for (uint32_t i = 0; i < count; i++) {
+        BusState s = {pc, 0, true, true, BUS_CYCLE};
+
+        if ((i & 1023) >= 900) {
+            // MARIA: display-list header from RAM, then graphics from ROM.
+            s.halt = false;
+            s.addr = ((i & 15) < 2) ? 0x1800 + (i & 0xFF) : 0xC000 + (i & 0x3FF);
+        } else if ((i & 63) == 63) {
+            uint32_t k = i >> 6;
+            s.addr = pokeyAddr + regs[k % sizeof(regs)];
+            s.read = false;
+            s.data = (uint8_t)(k * 37);
+        } else if ((i & 63) == 31) {
+            s.addr = pokeyAddr + 0x0A; // RANDOM
+        } else if ((i & 15) == 15) {
+            s.addr = 0x1800 + (i & 0xFF);
+            s.read = (i & 16) != 0;
+            s.data = (uint8_t)i;
+        } else {
+            pc = (pc == 0xFFFF) ? 0x8000 : pc + 1;
+        }
+        out.push_back(s);
+    }
+}
+
+// The page table against the plain decode: ROM byte for byte (bank 0 in
+// a switched window), POKEY's whole page over whatever the cart maps
+// there, everything else listens.
+static int checkMap() {
+    busEngineBegin<BusHal>();
+    uint32_t errors = 0;
+    for (uint32_t addr = 0; addr < 0x10000; addr++) {
+        const PageEntry &page = PAGE_TABLE[addr >> 8];
+        int rom = referenceByte(addr, 0);
+        bool ok;
+        if (rom >= 0) {
+            ok = servedByte(addr) == rom;
+        } else if (inPokeyPage(addr)) {
+            ok = page.kind == PAGE_POKEY;
+        } else if (hasCartRam(cartMapper) && addr >= 0x4000 && addr < 0x8000) {
+            ok = page.kind == PAGE_CART_RAM;
+        } else {
+            ok = page.kind != PAGE_ROM && page.kind != PAGE_BANK && page.kind != PAGE_SWITCH;
+        }
+        if (!ok && errors++ < 10) {
+            fprintf(stderr, "check-map: $%04X kind %u\n", addr, page.kind);
+        }
+    }
+    fprintf(stderr, "check-map: %s, 65536 addresses, %u mismatches\n", cartMapperName(cartMapper), errors);
+    return errors ? 1 : 0;
+}
+
+// What a read in the bank stream returns: cart RAM is never written there,
+// so it reads back as cleared at boot.
+static int bankStreamByte(uint32_t addr, uint32_t bank) {
+    if (cartConfig.pokeyAddr && IS_POKEY_ADDR(addr, cartConfig.pokeyAddr)) return EXPECT_POKEY;
+    if (hasCartRam(cartMapper) && inCartRam(addr)) return 0;
+    return referenceByte(addr, bank);
+}
+
+// Bank switches (the mapper's register write, occasionally a value or
+// address that must not switch) between runs of CPU fetches from the window
+// and the fixed banks, RAM traffic and MARIA bursts. `expect` is the byte
+// each read should see, -1 where the cart must listen, EXPECT_POKEY for
+// a POKEY register.
+static void synthesizeBanks(uint32_t count, std::vector<BusState> &out, std::vector<int> &expect) {
+    uint32_t banks = cartRomSize >> 14;
+    uint32_t window = bankWindow(cartMapper);
+    uint32_t bank = 0;
+    uint32_t seed = 0x7800;
+    uint16_t pc = 0xC000;
+
+    while (out.size() < count) {
+        seed = seed * 1103515245u + 12345u;
+        uint32_t r = seed >> 8;
+        BusState s = {0, 0, true, true, BUS_CYCLE};
+
+        switch (r & 7) {
+        case 0: {
+            // LDA #bank / STA reg: operand fetches, then the write.
+            uint8_t value = (uint8_t)((r >> 4) % ((r & 0x800) ? 256 : banks));
+            for (int i = 0; i < 4; i++) {
+                s.addr = pc = (pc >= 0xFFFF) ? 0xC000 : pc + 1;
+                out.push_back(s);
+                expect.push_back(bankStreamByte(s.addr, bank));
+            }
+            if (cartMapper == MAPPER_ABSOLUTE) {
+                s.addr = (r & 0x1000) ? 0x8000 | ((r >> 13) & 0xFF) : 0x8000;
+                value = (uint8_t)(r >> 4) & 3;
+            } else if (cartMapper == MAPPER_ACTIVISION) {
+                s.addr = 0xFF80 + ((r >> 12) & 0x1F);
+            } else {
+                s.addr = 0x8000 | ((r >> 12) & 0x3FFF);
+            }
+            s.read = false;
+            s.data = value;
+            out.push_back(s);
+            expect.push_back(-1);
+            bank = referenceBank(s.addr, value, bank);
+            break;
+        }
+        case 1:
+        case 2: {
+            // Straight-line code (or data) in the window.
+            uint32_t addr = window + ((r >> 4) & 0x3FFF);
+            for (uint32_t n = (r >> 20) & 63; n-- && addr < window + 0x4000; addr++) {
+                s.addr = (uint16_t)addr;
+                out.push_back(s);
+                expect.push_back(bankStreamByte(addr, bank));
+            }
+            break;
+        }
+        case 3: {
+            // MARIA: graphics from the window and both fixed banks.
+            s.halt = false;
+            for (uint32_t n = 0; n < 48; n++) {
+                seed = seed * 1103515245u + 12345u;
+                s.addr = 0x4000 + ((seed >> 8) % 0xC000);
+                out.push_back(s);
+                expect.push_back(bankStreamByte(s.addr, bank));
+            }
+            break;
+        }
+        case 4:
+            // RAM write/read.
+            s.addr = 0x1800 | ((r >> 4) & 0x7FF);
+            s.read = (r & 0x100) != 0;
+            s.data = (uint8_t)r;
+            out.push_back(s);
+            expect.push_back(-1);
+            break;
+        default:
+            // Single reads anywhere in cart space.
+            s.addr = 0x4000 + ((r >> 4) % 0xC000);
+            out.push_back(s);
+            expect.push_back(bankStreamByte(s.addr, bank));
+            break;
+        }
+    }
+}
+
+// Run the engine over `states` and compare the byte the console would
+// latch at the end of each one with `expect` (-1: the cart must listen,
+// EXPECT_POKEY: any byte).
+static uint32_t replayChecked(const char *name, const std::vector<BusState> &states,
+                              const std::vector<int> &expect) {
+    std::vector<int16_t> got;
+    hostBus.load(states);
+    hostBus.latched = &got;
+    busEngineBegin<BusHal>();
+    busEngineServe<BusHal>();
+    hostBus.latched = NULL;
+
+    uint32_t errors = 0;
+    for (size_t i = 0; i < states.size() && i < got.size(); i++) {
+        const BusState &s = states[i];
+        bool ok = expect[i] == EXPECT_POKEY || (expect[i] >= 0 ? got[i] == expect[i] : got[i] < 0);
+        if (!ok && errors++ < 10) {
+            fprintf(stderr, "%s: state %zu $%04X %c expected %d got %d\n",
+                    name, i, s.addr, s.read ? 'R' : 'W', expect[i], got[i]);
+        }
+    }
+#ifdef BUS_STATS
+    busStats.print();
+#endif
+    return errors;
+}
+
+static int checkBanks(uint32_t count) {
+    // Resolve the mapper the engine will use, then build the stream for it.
+    busEngineBegin<BusHal>();
+    if (romMapper(cartMapper) == MAPPER_FLAT) {
+        fprintf(stderr, "check-banks: image is not banked (or too small for its mapper)\n");
+        return 1;
+    }
+
+    std::vector<BusState> states;
+    std::vector<int> expect;
+    synthesizeBanks(count, states, expect);
+    uint32_t errors = replayChecked("check-banks", states, expect);
+
+    uint32_t reads = 0, writes = 0;
+    for (size_t i = 0; i < states.size(); i++) {
+        if (expect[i] >= 0) reads++;
+        if (!states[i].read && states[i].addr >= 0x8000) writes++;
+    }
+    fprintf(stderr, "check-banks: %s, %u banks, %zu states, %u cart reads, %u bank writes, %u mismatches\n",
+            cartMapperName(cartMapper), cartRomSize >> 14, states.size(), reads, writes, errors);
+    return errors ? 1 : 0;
+}
+
+// Cart RAM traffic between fetches from the fixed ROM at $C000: STA/LDA,
+// INC (read, dummy write of the old value, write of the new one), block
+// fills and read-backs, stores read back on the very next cycle, MARIA
+// bursts over RAM and ROM, and console RAM. `ram` models the cart RAM
+// (cleared at boot, like the engine's); `expect` is as for
+// synthesizeBanks.
+static void synthesizeRam(uint32_t count, std::vector<BusState> &out, std::vector<int> &expect) {
+    std::vector<uint8_t> ram(0x4000, 0);
+    uint32_t seed = 0x4000;
+    uint16_t pc = 0xC000;
+    uint16_t recent = 0x4000;   // Last address stored to
+
+    // One read of `addr`: RAM from the model, else the ROM decode.
+    auto load = [&](uint16_t addr, bool halt) {
+        BusState s = {addr, 0, true, halt, BUS_CYCLE};
+        out.push_back(s);
+        if (cartConfig.pokeyAddr && IS_POKEY_ADDR(addr, cartConfig.pokeyAddr)) {
+            expect.push_back(EXPECT_POKEY);
+        } else {
+            expect.push_back(inCartRam(addr) ? ram[addr & 0x3FFF] : referenceByte(addr, 0));
+        }
+    };
+    auto store = [&](uint16_t addr, uint8_t value) {
+        BusState s = {addr, value, false, true, BUS_CYCLE};
+        out.push_back(s);
+        expect.push_back(-1);
+        if (inCartRam(addr)) ram[addr & 0x3FFF] = value;
+    };
+    auto fetch = [&](int n) {
+        while (n--) load(pc = (pc >= 0xFFFF) ? 0xC000 : pc + 1, true);
+    };
+
+    while (out.size() < count) {
+        seed = seed * 1103515245u + 12345u;
+        uint32_t r = seed >> 8;
+        uint16_t addr = (r & 0x10) ? recent : 0x4000 | ((r >> 12) & 0x3FFF);
+
+        switch (r & 7) {
+        case 0:
+            // STA abs, sometimes read straight back on the next cycle.
+            fetch(3);
+            store(addr, (uint8_t)(r >> 4));
+            recent = addr;
+            if (r & 0x20) load(addr, (r & 0x40) != 0);
+            break;
+        case 1:
+            // LDA abs.
+            fetch(3);
+            load(addr, true);
+            break;
+        case 2: {
+            // INC abs.
+            fetch(3);
+            uint8_t old = ram[addr & 0x3FFF];
+            load(addr, true);
+            store(addr, old);
+            store(addr, (uint8_t)(old + 1));
+            recent = addr;
+            break;
+        }
+        case 3: {
+            // Block fill, then read back.
+            uint16_t start = 0x4000 | ((r >> 12) & 0x3FC0);
+            uint32_t n = (r >> 4) & 31;
+            for (uint32_t i = 0; i < n; i++) {
+                fetch(1);
+                store(start + i, (uint8_t)(r + i * 7));
+            }
+            for (uint32_t i = 0; i < n; i++) {
+                load(start + i, true);
+            }
+            break;
+        }
+        case 4:
+            // MARIA: graphics from cart RAM and ROM.
+            for (uint32_t n = 0; n < 32; n++) {
+                seed = seed * 1103515245u + 12345u;
+                uint32_t q = seed >> 8;
+                load((q & 1) ? 0x4000 | ((q >> 4) & 0x3FFF) : 0xC000 | ((q >> 4) & 0x3FFF), false);
+            }
+            break;
+        case 5: {
+            // Console RAM write/read.
+            BusState s = {(uint16_t)(0x1800 | ((r >> 4) & 0x7FF)), (uint8_t)r, (r & 0x100) != 0, true, BUS_CYCLE};
+            out.push_back(s);
+            expect.push_back(-1);
+            break;
+        }
+        default:
+            fetch(1 + (r >> 4) % 8);
+            break;
+        }
+    }
+}
+
+static int checkRam(uint32_t count) {
+    busEngineBegin<BusHal>();
+    if (!hasCartRam(cartMapper)) {
+        fprintf(stderr, "check-ram: image has no cart RAM\n");
+        return 1;
+    }
+
+    std::vector<BusState> states;
+    std::vector<int> expect;
+    synthesizeRam(count, states, expect);
+    uint32_t errors = replayChecked("check-ram", states, expect);
+
+    uint32_t reads = 0, writes = 0;
+    for (size_t i = 0; i < states.size(); i++) {
+        bool inRam = inCartRam(states[i].addr);
+        if (inRam && states[i].read) reads++;
+        if (inRam && !states[i].read) writes++;
+    }
+    fprintf(stderr, "check-ram: %s, %zu states, %u RAM reads, %u RAM writes, %u mismatches\n",
+            cartMapperName(cartMapper), states.size(), reads, writes, errors);
+    return errors ? 1 : 0;
+}
+
+// POKEY writes separated only by what the sniffer used to miss: ROM
+// fetches (predicted or not), a MARIA burst, a POKEY read, a console RAM
+// write, or nothing but the next write. Starts with STA $0450/#$AA, five
+// fetches, STA $0451/#$BB. `expect` gets the state index of each write.
+static void synthesizePokeyWrites(uint32_t count, std::vector<BusState> &out,
+                                  std::vector<size_t> &expect) {
+    uint16_t base = cartConfig.pokeyAddr;
+    uint32_t seed = 0x0450;
+    uint16_t pc = 0xC000;
+
+    auto fetch = [&](uint32_t n) {
+        while (n--) {
+            BusState s = {pc = (pc >= 0xFFFF) ? 0xC000 : pc + 1, 0, true, true, BUS_CYCLE};
+            out.push_back(s);
+        }
+    };
+    auto store = [&](uint8_t reg, uint8_t value) {
+        BusState s = {(uint16_t)(base + reg), value, false, true, BUS_CYCLE};
+        expect.push_back(out.size());
+        out.push_back(s);
+    };
+
+    fetch(3);
+    store(0x00, 0xAA);
+    fetch(5);
+    store(0x01, 0xBB);
+
+    while (out.size() < count) {
+        seed = seed * 1103515245u + 12345u;
+        uint32_t r = seed >> 8;
+        uint8_t reg = (uint8_t)((r >> 4) & 0x0F);
+
+        fetch(2);
+        store(reg, (uint8_t)(r >> 12));
+        switch (r & 7) {
+        case 0:
+            // The same register again after the next instruction's fetches.
+            fetch(1 + (r >> 20) % 4);
+            break;
+        case 1:
+            // MARIA takes the bus right after the write.
+            for (uint32_t n = 0; n < 8 + (r >> 20) % 24; n++) {
+                BusState s = {(uint16_t)(0xC000 + ((r + n * 97) & 0x3FFF)), 0, true, false, BUS_CYCLE};
+                out.push_back(s);
+            }
+            break;
+        case 2: {
+            // RANDOM read, then straight on.
+            BusState s = {(uint16_t)(base + 0x0A), 0, true, true, BUS_CYCLE};
+            out.push_back(s);
+            break;
+        }
+        case 3: {
+            BusState s = {(uint16_t)(0x1800 | ((r >> 8) & 0x7FF)), (uint8_t)r, false, true, BUS_CYCLE};
+            out.push_back(s);
+            break;
+        }
+        case 4:
+            // Next write with no cycle in between.
+            break;
+        default:
+            fetch(1 + (r >> 20) % 8);
+            break;
+        }
+        if ((r & 7) == 0) {
+            store(reg, (uint8_t)~(r >> 12));
+        }
+    }
+    fetch(4);
+}
+
+// Every write must be committed once, in order, with its own value and a
+// timestamp inside its own bus cycle.
+static int checkPokeyWrites(uint32_t count) {
+    if (!cartConfig.pokeyAddr) setCartType(cartConfig.cartType);
+    std::vector<BusState> states;
+    std::vector<size_t> expect;
+    synthesizePokeyWrites(count, states, expect);
+
+    std::vector<uint32_t> start(states.size());
+    for (size_t i = 1; i < states.size(); i++) start[i] = start[i - 1] + states[i - 1].cycles;
+
+    std::vector<SniffedWrite> got;
+    hostBus.load(states);
+    hostBus.sniffed = &got;
+    busEngineBegin<BusHal>();
+    busEngineServe<BusHal>();
+    hostBus.sniffed = NULL;
+
+    uint32_t errors = 0;
+    for (size_t i = 0; i < expect.size() || i < got.size(); i++) {
+        bool ok = i < expect.size() && i < got.size();
+        if (ok) {
+            const BusState &s = states[expect[i]];
+            const SniffedWrite &w = got[i];
+            ok = w.reg == s.addr - cartConfig.pokeyAddr && w.value == s.data
+                 && w.cycle - start[expect[i]] < s.cycles;
+        }
+        if (!ok && errors++ < 10) {
+            if (i < expect.size()) {
+                const BusState &s = states[expect[i]];
+                fprintf(stderr, "check-pokey-writes: write %zu: expected %02X %02X in [%u, %u)",
+                        i, s.addr - cartConfig.pokeyAddr, s.data, start[expect[i]],
+                        start[expect[i]] + s.cycles);
+            } else {
+                fprintf(stderr, "check-pokey-writes: write %zu: none expected", i);
+            }
+            if (i < got.size()) {
+                fprintf(stderr, ", got W %u %02X %02X\n", got[i].cycle, got[i].reg, got[i].value);
+            } else {
+                fprintf(stderr, ", got nothing\n");
+            }
+        }
+    }
+    fprintf(stderr, "check-pokey-writes: POKEY at $%04X, %zu states, %zu writes, %zu committed, %u mismatches\n",
+            cartConfig.pokeyAddr, states.size(), expect.size(), got.size(), errors);
+    return errors ? 1 : 0;
+}
+
+// Data setup the CPU needs before PHI2 falls (50 ns), in DWT cycles. A
+// read byte that goes out later than the end of the state minus this is late.
+static const uint32_t READ_SETUP = (uint32_t)((uint64_t)F_CPU * 50 / 1000000000u);
+
+// What each POKEY register reads as on the 7800 with no IRQ enabled: pots
+// fully counted, ALLPOT done, the rest idle high. -2 for RANDOM (any byte,
+// as long as one is driven).
+static int pokeyReadValue(uint8_t reg) {
+    reg &= 0x0F;
+    if (reg < 8) return 0xE4;
+    if (reg == 0x08) return 0x00;
+    if (reg == 0x0A) return -2;
+    return 0xFF;
+}
+
+// LDA of every POKEY register after opcode fetches, back-to-back reads, reads
+// straight after a MARIA burst, an AUDF/AUDC store or a RAM write. `expect`
+// is as for synthesizeBanks, with -2 for any driven byte.
+static void synthesizePokeyReads(uint32_t count, std::vector<BusState> &out, std::vector<int> &expect) {
+    uint16_t base = cartConfig.pokeyAddr;
+    uint32_t regs = PokeyWrapper::REG_MASK + 1u;
+    uint32_t seed = 0x045A;
+    uint16_t pc = 0xC000;
+
+    auto fetch = [&](uint32_t n) {
+        while (n--) {
+            BusState s = {pc = (pc >= 0xFFFF) ? 0xC000 : pc + 1, 0, true, true, BUS_CYCLE};
+            out.push_back(s);
+            expect.push_back(referenceByte(s.addr, 0));
+        }
+    };
+    auto read = [&](uint8_t reg) {
+        BusState s = {(uint16_t)(base + reg), 0, true, true, BUS_CYCLE};
+        out.push_back(s);
+        expect.push_back(pokeyReadValue(reg));
+    };
+
+    while (out.size() < count) {
+        seed = seed * 1103515245u + 12345u;
+        uint32_t r = seed >> 8;
+        uint8_t reg = (uint8_t)((r >> 4) % regs);
+
+        switch (r & 3) {
+        case 0: {
+            // MARIA burst, then the CPU reads POKEY first thing.
+            for (uint32_t n = 0; n < 8 + (r >> 20) % 24; n++) {
+                BusState s = {(uint16_t)(0xC000 + ((r + n * 97) & 0x3FFF)), 0, true, false, BUS_CYCLE};
+                out.push_back(s);
+                expect.push_back(referenceByte(s.addr, 0));
+            }
+            break;
+        }
+        case 1: {
+            // STA AUDFn/AUDCn (never IRQEN, which would change IRQST).
+            fetch(2);
+            BusState s = {(uint16_t)(base + ((r >> 12) & 7)), (uint8_t)(r >> 16), false, true, BUS_CYCLE};
+            out.push_back(s);
+            expect.push_back(-1);
+            break;
+        }
+        case 2: {
+            fetch(2);
+            BusState s = {(uint16_t)(0x1800 | ((r >> 8) & 0x7FF)), (uint8_t)r, false, true, BUS_CYCLE};
+            out.push_back(s);
+            expect.push_back(-1);
+            break;
+        }
+        default:
+            fetch(1 + (r >> 20) % 3);
+            break;
+        }
+        read(reg);
+        if (r & 0x100) read((uint8_t)((reg + 1) % regs));
+    }
+    fetch(2);
+}
+
+// Every POKEY read must have its register's byte on the bus READ_SETUP
+// before the state ends; prints how far into the cycle it went out.
+static int checkPokeyReads(uint32_t count) {
+    if (!cartConfig.pokeyAddr) setCartType(cartConfig.cartType);
+    busEngineBegin<BusHal>();
+    std::vector<BusState> states;
+    std::vector<int> expect;
+    synthesizePokeyReads(count, states, expect);
+
+    std::vector<int16_t> got;
+    std::vector<uint32_t> at;
+    hostBus.load(states);
+    hostBus.latched = &got;
+    hostBus.drivenAt = &at;
+    busEngineBegin<BusHal>();
+    busEngineServe<BusHal>();
+    hostBus.latched = NULL;
+    hostBus.drivenAt = NULL;
+
+    uint32_t errors = 0, late = 0, reads = 0, worst = 0;
+    uint64_t total = 0;
+    for (size_t i = 0; i < states.size() && i < got.size(); i++) {
+        const BusState &s = states[i];
+        bool pokeyRead = s.read && IS_POKEY_ADDR(s.addr, cartConfig.pokeyAddr);
+        bool ok = expect[i] == -2 ? got[i] >= 0 : expect[i] >= 0 ? got[i] == expect[i] : got[i] < 0;
+        if (!ok && errors++ < 10) {
+            fprintf(stderr, "check-pokey-reads: state %zu $%04X %c expected %d got %d\n",
+                    i, s.addr, s.read ? 'R' : 'W', expect[i], got[i]);
+        }
+        if (!pokeyRead || got[i] < 0) continue;
+        reads++;
+        total += at[i];
+        if (at[i] > worst) worst = at[i];
+        if (at[i] + READ_SETUP > s.cycles && late++ < 10) {
+            fprintf(stderr, "check-pokey-reads: state %zu $%04X driven %u cycles in, after the %u-cycle window\n",
+                    i, s.addr, at[i], s.cycles - READ_SETUP);
+        }
+    }
+    fprintf(stderr, "check-pokey-reads: POKEY at $%04X, %zu states, %u POKEY reads, latency avg %.0f max %u cycles (%.0f ns, window %u), %u mismatches, %u late\n",
+            cartConfig.pokeyAddr, states.size(), reads, reads ? (double)total / reads : 0.0, worst,
+            worst * 1e9 / F_CPU, BUS_CYCLE - READ_SETUP, errors, late);
+#ifdef BUS_STATS
+    busStats.print();
+#endif
+    return (errors || late) ? 1 : 0;
+}
+
+// One IRQ timer setup for checkIrq(): registers written before STIMER, the
+// IRQEN bit to enable and the channel whose divider is the timer.
+struct IrqTimer {
+    const char *name;
+    uint8_t audctl;
+    uint8_t audf[4];
+    uint8_t enable;     // IRQEN bit: 1, 2 or 4 for timers 1, 2, 4
+    int channel;
+};
+
+// Bus cycles from a due IRQ to the handler's IRQEN acknowledge.
+#define IRQ_ACK_DELAY 24
+
+// Program the timer, STIMER, then a wait loop (two fetches and a RAM read)
+// that acknowledges each IRQ IRQ_ACK_DELAY bus cycles after it is due with
+// IRQEN = 0 then IRQEN = `enable`. `acks` gets the state index of each
+// IRQEN = 0 write.
+static void synthesizeIrq(const IrqTimer &timer, uint32_t irqs, uint32_t period,
+                          std::vector<BusState> &out, std::vector<size_t> &acks) {
+    uint16_t base = cartConfig.pokeyAddr;
+    uint16_t pc = 0xC000;
+    auto fetch = [&](uint32_t n) {
+        while (n--) {
+            BusState s = {pc = (pc >= 0xFFFF) ? 0xC000 : pc + 1, 0, true, true, BUS_CYCLE};
+            out.push_back(s);
+        }
+    };
+    auto store = [&](uint8_t reg, uint8_t value) {
+        fetch(2);
+        BusState s = {(uint16_t)(base + reg), value, false, true, BUS_CYCLE};
+        out.push_back(s);
+    };
+
+    store(0x08, timer.audctl);
+    for (int i = 0; i < 4; i++) store((uint8_t)(i * 2), timer.audf[i]);
+    store(0x0E, timer.enable);
+    store(0x09, 0);
+    uint64_t start = (uint64_t)(out.size() - 1) * BUS_CYCLE;
+
+    for (uint32_t k = 1; k <= irqs; k++) {
+        uint64_t due = start + (uint64_t)k * period;
+        size_t ack = (size_t)(due / BUS_CYCLE) + IRQ_ACK_DELAY;
+        while (out.size() + 3 < ack) {
+            fetch(2);
+            BusState s = {0x0080, 0, true, true, BUS_CYCLE};
+            out.push_back(s);
+        }
+        acks.push_back(out.size() + 2);
+        store(0x0E, 0);
+        store(0x0E, timer.enable);
+    }
+    fetch(8);
+}
+
+// Timer 1 (4 ms at 64 kHz) masked with IRQEN = 0 for IRQ_MASK_CYCLES, past
+// the 2^31-cycle signed compare window, then re-enabled without STIMER.
+#define IRQ_MASK_CYCLES (3u * F_CPU)
+
+// STIMER, IRQEN = 0, a RAM read held for IRQ_MASK_CYCLES, IRQEN = 1, then
+// the wait loop for two periods and an acknowledge. Returns the cycle the
+// IRQEN = 1 state starts.
+static uint32_t synthesizeIrqMasked(uint32_t period, std::vector<BusState> &out) {
+    uint16_t base = cartConfig.pokeyAddr;
+    uint16_t pc = 0xC000;
+    uint32_t now = 0;
+    auto push = [&](BusState s) {
+        out.push_back(s);
+        now += s.cycles;
+    };
+    auto fetch = [&](uint32_t n) {
+        while (n--) {
+            BusState s = {pc = (pc >= 0xFFFF) ? 0xC000 : pc + 1, 0, true, true, BUS_CYCLE};
+            push(s);
+        }
+    };
+    auto store = [&](uint8_t reg, uint8_t value) {
+        fetch(2);
+        BusState s = {(uint16_t)(base + reg), value, false, true, BUS_CYCLE};
+        push(s);
+    };
+
+    store(0x08, 0);
+    store(0x00, 0xFF);
+    store(0x0E, 1);
+    store(0x09, 0);
+    store(0x0E, 0);
+    // A RAM read held in pieces (the host clock compares state ends in a
+    // signed 32-bit window too).
+    for (uint32_t left = IRQ_MASK_CYCLES; left; ) {
+        BusState masked = {0x0080, 0, true, true, left < (1u << 28) ? left : (1u << 28)};
+        push(masked);
+        left -= masked.cycles;
+    }
+    fetch(2);
+    uint32_t enabled = now;
+    store(0x0E, 1);
+    for (uint32_t end = now + 2 * period; (int32_t)(now - end) < 0; ) {
+        fetch(2);
+        BusState s = {0x0080, 0, true, true, BUS_CYCLE};
+        push(s);
+    }
+    store(0x0E, 0);
+    fetch(8);
+    return enabled;
+}
+
+// The IRQ after a long mask must come at the first STIMER + k periods after
+// the re-enable, as if the timer had kept counting, and be acknowledged.
+static int checkIrqMasked() {
+    uint8_t audf[4] = {0xFF, 0, 0, 0};
+    uint32_t cyclesPerClock16 = (uint32_t)(((uint64_t)CYCLES_PER_SAMPLE << 16) / Pokey::CLOCKS_PER_TICK);
+    uint32_t period = (uint32_t)(((uint64_t)Pokey::ClockPeriod(0, audf, 0) * cyclesPerClock16) >> 16);
+
+    std::vector<BusState> states;
+    uint32_t enabled = synthesizeIrqMasked(period, states);
+
+    std::vector<SniffedWrite> writes;
+    std::vector<uint32_t> edges;
+    hostBus.load(states);
+    hostBus.sniffed = &writes;
+    hostBus.irqEdgeAt = &edges;
+    busEngineBegin<BusHal>();
+    busEngineServe<BusHal>();
+    hostBus.sniffed = NULL;
+    hostBus.irqEdgeAt = NULL;
+
+    uint32_t stimer = 0;
+    for (const SniffedWrite &w : writes) {
+        if (w.reg == 0x09) stimer = w.cycle;
+    }
+    uint32_t due = stimer + ((enabled - stimer) / period + 1) * period;
+    int32_t rise = edges.empty() ? 0 : (int32_t)(edges[0] - due);
+    bool ok = edges.size() == 2 && rise >= 0 && rise <= 3 * (int32_t)BUS_CYCLE;
+    fprintf(stderr, "check-irq: timer 1 masked %.1f s then re-enabled: %zu edges, rise %.2f ms after re-enable (%d cycles after due), %u mismatches\n",
+            (double)IRQ_MASK_CYCLES / F_CPU, edges.size(),
+            edges.empty() ? 0.0 : (double)(edges[0] - enabled) * 1000.0 / F_CPU, rise, ok ? 0 : 1);
+    return ok ? 0 : 1;
+}
+
+// Each timer IRQ must rise at STIMER + k periods (never early, at most the
+// wait loop's three bus cycles late, no drift) and drop within the bus
+// cycle after the IRQEN = 0 acknowledge, for timers 1, 2 and 4 under
+// several AUDCTL clocks. The times are the log's "I" lines.
+static int checkIrq(uint32_t irqs) {
+    static const IrqTimer timers[] = {
+        {"timer 1, 64 kHz",      0x00, {0x3F, 0, 0, 0}, 1, 0},
+        {"timer 2, 15 kHz",      0x01, {0, 0x0F, 0, 0}, 2, 1},
+        {"timer 4, 16-bit 1.79", 0x28, {0, 0, 0x00, 0x07}, 4, 3},
+        {"timer 1, 1.79 MHz",    0x40, {0xFF, 0, 0, 0}, 1, 0},
+    };
+    if (!cartConfig.pokeyAddr) setCartType(cartConfig.cartType);
+    uint32_t cyclesPerClock16 = (uint32_t)(((uint64_t)CYCLES_PER_SAMPLE << 16) / Pokey::CLOCKS_PER_TICK);
+    const uint32_t tolerance = 3 * BUS_CYCLE;
+    int result = 0;
+
+    for (const IrqTimer &timer : timers) {
+        uint32_t clocks = Pokey::ClockPeriod(timer.audctl, timer.audf, timer.channel);
+        uint32_t period = (uint32_t)(((uint64_t)clocks * cyclesPerClock16) >> 16);
+
+        std::vector<BusState> states;
+        std::vector<size_t> acks;
+        synthesizeIrq(timer, irqs, period, states, acks);
+
+        std::vector<SniffedWrite> writes;
+        std::vector<uint32_t> edges;
+        hostBus.load(states);
+        hostBus.sniffed = &writes;
+        hostBus.irqEdgeAt = &edges;
+        busEngineBegin<BusHal>();
+        busEngineServe<BusHal>();
+        hostBus.sniffed = NULL;
+        hostBus.irqEdgeAt = NULL;
+
+        uint32_t stimer = 0;
+        for (const SniffedWrite &w : writes) {
+            if (w.reg == 0x09) stimer = w.cycle;
+        }
+
+        uint32_t errors = 0;
+        int32_t worstRise = 0, worstFall = 0;
+        if (edges.size() != 2 * acks.size()) {
+            errors++;
+            fprintf(stderr, "check-irq: %s: %zu edges, expected %zu\n", timer.name, edges.size(), 2 * acks.size());
+        }
+        for (size_t k = 0; k < acks.size() && 2 * k + 1 < edges.size(); k++) {
+            int32_t rise = (int32_t)(edges[2 * k] - (stimer + (uint32_t)(k + 1) * period));
+            int32_t fall = (int32_t)(edges[2 * k + 1] - (uint32_t)(acks[k] * BUS_CYCLE));
+            if (rise > worstRise) worstRise = rise;
+            if (fall > worstFall) worstFall = fall;
+            if ((rise < 0 || rise > (int32_t)tolerance || fall < 0 || fall >= 2 * (int32_t)BUS_CYCLE)
+                && errors++ < 10) {
+                fprintf(stderr, "check-irq: %s: IRQ %zu rose %d cycles after due, dropped %d cycles after the ack started\n",
+                        timer.name, k + 1, rise, fall);
+            }
+        }
+        fprintf(stderr, "check-irq: %s, period %u clocks (%u cycles), %zu IRQs, rise late by up to %d cycles, drop %d cycles into the ack, %u mismatches\n",
+                timer.name, clocks, period, acks.size(), worstRise, worstFall, errors);
+        if (errors) result = 1;
+    }
+    return checkIrqMasked() | result;
+}
+
+// PokeyWriteQueue against a simulated producer and consumer. The producer
+// stages each write several times (the value settling), commits it, and
+// stalls now and then; the consumer drains what is due at an advancing
+// cycle and sometimes stops for longer than the ring holds. Every write
+// must come out once, in order, with its first-seen cycle and last value,
+// or be counted as an overflow, and never before it is due.
+static int checkQueue(uint32_t count) {
+    PokeyWriteQueue queue;
+    std::vector<PokeyWrite> sent;   // Committed and not dropped, in order
+    uint32_t dropped = 0;
+    size_t received = 0;
+    uint32_t errors = 0;
+    uint32_t seed = 0x0E0E;
+    uint32_t now = 0;
+    uint32_t consumerCycle = 0;
+    uint32_t stall = 0;             // Consumer passes left to skip
+
+    for (uint32_t i = 0; i < count; i++) {
+        seed = seed * 1103515245u + 12345u;
+        uint32_t r = seed >> 8;
+        now += 1 + (r & 0xFF);
+
+        // Producer: one write, restaged 1-4 times.
+        PokeyWrite w = {now, (uint8_t)((r >> 8) & 0x0F), 0};
+        for (uint32_t n = 0; n <= ((r >> 12) & 3); n++) {
+            w.value = (uint8_t)(r >> (14 + n));
+            queue.stage(now + n, w.reg, w.value);
+        }
+        uint32_t before = queue.overflows();
+        queue.commit();
+        if (queue.overflows() != before) {
+            dropped++;
+        } else {
+            sent.push_back(w);
+        }
+
+        // Consumer: catches up to `now`, unless stalled.
+        if (stall) {
+            stall--;
+            continue;
+        }
+        if ((r >> 16) % 500 == 0) stall = PokeyWriteQueue::SIZE + (r >> 24);
+        uint32_t target = now - ((r >> 20) & 0x3FF);
+        while ((int32_t)(target - consumerCycle) > 0) {
+            consumerCycle += 1 + ((r >> 4) & 0x7F);
+            PokeyWrite got;
+            while (queue.popDue(consumerCycle, got)) {
+                bool ok = received < sent.size() && got.cycle == sent[received].cycle
+                          && got.reg == sent[received].reg && got.value == sent[received].value
+                          && (int32_t)(got.cycle - consumerCycle) <= 0;
+                if (!ok && errors++ < 10) {
+                    fprintf(stderr, "check-queue: write %zu: got %u %02X %02X at cycle %u\n",
+                            received, got.cycle, got.reg, got.value, consumerCycle);
+                }
+                received++;
+            }
+        }
+    }
+    PokeyWrite got;
+    while (queue.popDue(now, got)) {
+        if (received >= sent.size() || got.cycle != sent[received].cycle) errors++;
+        received++;
+    }
+    if (received != sent.size()) errors++;
+    if (queue.overflows() != dropped) errors++;
+
+    fprintf(stderr, "check-queue: %u writes, %zu delivered, %u overflows, %u mismatches\n",
+            count, received, queue.overflows(), errors);
+    return errors || !dropped ? 1 : 0;
+}
+
+static int usage() {
+    fprintf(stderr, "usage: bus_sim [--rom game.a78 | --mapper name] [--log file] [--access N] [--settle N] (trace.txt | --synthetic N | --check-header | --check-load | --check-map | --check-banks N | --check-ram N | --check-pokey-writes N | --check-pokey-reads N | --check-irq N | --check-queue N)\n");
+    return 2;
+}
+
+int main(int argc, char **argv) {
+    const char *tracePath = NULL;
+    const char *logPath = NULL;
+    const char *romPath = NULL;
+    uint32_t synthetic = 0;
+    uint32_t bankCheck = 0;
+    uint32_t ramCheck = 0;
+    uint32_t pokeyWriteCheck = 0;
+    uint32_t queueCheck = 0;
+    uint32_t pokeyReadCheck = 0;
+    uint32_t irqCheck = 0;
+    bool mapCheck = false;
+    bool loadCheck = false;
+    bool headerCheck = false;
+    bool generate = false;
+    std::vector<BusState> states;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--rom") && i + 1 < argc) {
+            romPath = argv[++i];
+            A78Image image;
+            A78Status status = loadRom(romPath, image);
+            if (status != A78_OK) {
+                fprintf(stderr, "bus_sim: cannot load ROM %s: %s\n", romPath, a78StatusName(status));
+                return 1;
+            }
+            generate = false;
+        } else if (!strcmp(argv[i], "--mapper") && i + 1 < argc) {
+            const char *name = argv[++i];
+            if (!strcmp(name, "flat-ram")) {
+                setCartType(CART_TYPE_RAM);
+            } else if (!strcmp(name, "supergame")) {
+                setCartType(CART_TYPE_SUPERGAME);
+            } else if (!strcmp(name, "supergame-144k")) {
+                setCartType(CART_TYPE_SUPERGAME);
+                testRomBanks = 9;
+            } else if (!strcmp(name, "supergame-exrom")) {
+                setCartType(CART_TYPE_SUPERGAME | CART_TYPE_ROM_4000);
+            } else if (!strcmp(name, "supergame-bank6")) {
+                setCartType(CART_TYPE_SUPERGAME | CART_TYPE_BANK6_4000);
+                testRomBanks = 16;
+            } else if (!strcmp(name, "supergame-ram")) {
+                setCartType(CART_TYPE_SUPERGAME | CART_TYPE_RAM);
+            } else if (!strcmp(name, "absolute")) {
+                setCartType(CART_TYPE_ABSOLUTE);
+            } else if (!strcmp(name, "activision")) {
+                setCartType(CART_TYPE_ACTIVISION);
+            } else {
+                return usage();
+            }
+            generate = true;
+        } else if (!strcmp(argv[i], "--log") && i + 1 < argc) {
+            logPath = argv[++i];
+        } else if (!strcmp(argv[i], "--access") && i + 1 < argc) {
+            hostBus.accessCycles = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--settle") && i + 1 < argc) {
+            hostBus.settleCycles = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--check-header")) {
+            headerCheck = true;
+        } else if (!strcmp(argv[i], "--check-load")) {
+            loadCheck = true;
+        } else if (!strcmp(argv[i], "--check-map")) {
+            mapCheck = true;
+        } else if (!strcmp(argv[i], "--check-banks") && i + 1 < argc) {
+            bankCheck = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--check-ram") && i + 1 < argc) {
+            ramCheck = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--check-pokey-writes") && i + 1 < argc) {
+            pokeyWriteCheck = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--check-pokey-reads") && i + 1 < argc) {
+            pokeyReadCheck = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--check-irq") && i + 1 < argc) {
+            irqCheck = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--check-queue") && i + 1 < argc) {
+            queueCheck = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--synthetic") && i + 1 < argc) {
+            synthetic = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (argv[i][0] != '-' && !tracePath) {
+            tracePath = argv[i];
+        } else {
+            return usage();
+        }
+    }
+
+    if (headerCheck) {
+        return checkHeader();
+    }
+    if (queueCheck) {
+        return checkQueue(queueCheck);
+    }
+    if (loadCheck) {
+        return romPath ? checkLoad(romPath) : usage();
+    }
+    if (generate || ((bankCheck || ramCheck) && !romImage.size())) {
+        makeTestRom(ramCheck ? CART_TYPE_SUPERGAME | CART_TYPE_RAM : CART_TYPE_SUPERGAME);
+    }
+    if (mapCheck) {
+        return checkMap();
+    }
+    if (bankCheck) {
+        return checkBanks(bankCheck);
+    }
+    if (ramCheck) {
+        return checkRam(ramCheck);
+    }
+    if (pokeyWriteCheck) {
+        return checkPokeyWrites(pokeyWriteCheck);
+    }
+    if (pokeyReadCheck) {
+        return checkPokeyReads(pokeyReadCheck);
+    }
+    if (irqCheck) {
+        return checkIrq(irqCheck);
+    }
+
+    if (tracePath) {
+        if (!loadTrace(tracePath, states)) {
+            fprintf(stderr, "bus_sim: no records in %s\n", tracePath);
+            return 1;
+        }
+    } else if (synthetic) {
+        synthesize(synthetic, states);
+    } else {
+        return usage();
+    }
+
+    FILE *log = NULL;
+    if (logPath) {
+        log = strcmp(logPath, "-") ? fopen(logPath, "w") : stdout;
+        if (!log) {
+            fprintf(stderr, "bus_sim: cannot open %s\n", logPath);
+            return 1;
+        }
+    }
+
+    hostBus.load(states);
+    hostBus.log = log;
+    busEngineBegin<BusHal>();
+
+    auto t0 = std::chrono::steady_clock::now();
+    busEngineServe<BusHal>();
+    auto t1 = std::chrono::steady_clock::now();
+    double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+
+    if (log && log != stdout) fclose(log);
+
+    uint32_t iters = hostBus.iterations ? hostBus.iterations : 1;
+    fprintf(stderr, "states %zu, sim cycles %u, loop passes %u (%.1f per state)\n",
+            states.size(), hostBus.now(), hostBus.iterations,
+            (double)hostBus.iterations / states.size());
+    fprintf(stderr, "driven %u, missed %u, write conflicts %u\n",
+            hostBus.driven, hostBus.missed, hostBus.conflicts);
+    fprintf(stderr, "pokey writes %u (queue overflows %u), audio samples %u, irq edges %u\n",
+            hostBus.pokeyWrites, pokey.queueOverflows(), hostBus.samples, hostBus.irqEdges);
+    fprintf(stderr, "host %.1f ms, %.1f ns per loop pass, %.2fx real time\n",
+            ns / 1e6, ns / iters, ((double)hostBus.now() * 1e9 / F_CPU) / ns);
+#ifdef BUS_STATS
+    busStats.print();
+#endif
+    return 0;
+}
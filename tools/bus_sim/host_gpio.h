@@ -0,0 +1,254 @@
+#ifndef HOST_GPIO_H
+#define HOST_GPIO_H
+
+// Host GPIO model and HAL policy behind bus_hal.h (-DBUS_SIM).
+//
+// Replays a list of bus states against the engine. Time is a fake DWT
+// counter that advances by `accessCycles` on every GPIO register read,
+// including the reads inside read-modify-write updates of DR/GDIR, so the
+// loop's sampling rate (and therefore torn addresses, late drives and clock
+// recovery) follows from how many reads each path does. Reading the cycle
+// counter itself costs one cycle. Everything the engine drives or emits is
+// logged against that clock.
+//
+// PHI2 is low for the first half of each state and high for the second,
+// the console latching read data at the end. CPU write data is only on the
+// bus while PHI2 is high (the lines float high before). For the first
+// `settleCycles` of a state the address lines still show the previous
+// address.
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <vector>
+
+// A POKEY write as the engine committed it.
+struct SniffedWrite {
+    uint32_t cycle;
+    uint8_t  reg;
+    uint8_t  value;
+};
+
+// One bus state as the cart sees it, held for `cycles` DWT cycles.
+struct BusState {
+    uint16_t addr;
+    uint8_t  data;    // CPU write data (unused for reads)
+    bool     read;    // R/W high
+    bool     halt;    // HALT high = CPU active
+    uint32_t cycles;
+};
+
+class HostBus {
+public:
+    uint32_t accessCycles; // DWT cycles charged per GPIO read
+    uint32_t settleCycles; // Address lines lag the state by this much
+    FILE*    log;          // Event log, or NULL
+    std::vector<int16_t> *latched; // Data bus at the end of each state
+                                   // (-1: not driven), or NULL
+    std::vector<SniffedWrite> *sniffed; // Committed POKEY writes, or NULL
+    std::vector<uint32_t> *drivenAt; // Cycles into each state the latched byte
+                                     // went out (0: already there), or NULL
+    std::vector<uint32_t> *irqEdgeAt; // Cycle of each IRQ line change, or NULL
+
+    // Counters for the run summary.
+    uint32_t iterations;   // Address reads (one per loop pass)
+    uint32_t driven;       // Read states that ended with the engine driving
+    uint32_t missed;       // Cart reads that ended undriven
+    uint32_t conflicts;    // CPU write states that ended with the engine driving
+    uint32_t pokeyWrites;
+    uint32_t samples;
+    uint32_t irqEdges;
+
+    HostBus() : accessCycles(6), settleCycles(0), log(NULL), latched(NULL), sniffed(NULL), drivenAt(NULL), irqEdgeAt(NULL) { load(std::vector<BusState>()); }
+
+    void load(const std::vector<BusState> &states) {
+        m_states = states;
+        m_index = 0;
+        m_now = 0;
+        m_end = m_states.empty() ? 0 : m_states[0].cycles;
+        m_prevAddr = 0;
+        m_driving = false;
+        m_driven = 0xFF;
+        m_drivenSince = 0;
+        m_irq = false;
+        iterations = driven = missed = conflicts = 0;
+        pokeyWrites = samples = irqEdges = 0;
+    }
+
+    bool running() const { return m_index < m_states.size(); }
+
+    uint32_t cycles() {
+        step(1);
+        return m_now;
+    }
+
+    uint32_t now() const { return m_now; }
+
+    // --- Inputs (same bit layout as the Teensy ports, see bus_hal.h) ---
+    uint32_t readGpio6() {
+        advance();
+        const BusState &s = current();
+        uint8_t d = m_driving ? m_driven : (s.read || !phi2() ? 0xFF : s.data);
+        return ((uint32_t)(addrLines() & 0xFF00) << 16) | ((uint32_t)d << 16);
+    }
+
+    uint32_t readGpio7() {
+        advance();
+        iterations++;
+        uint32_t a = addrLines();
+        return (a & 0x0F) | ((a & 0x70) << 6) | ((a & 0x80) << 9);
+    }
+
+    uint32_t readGpio9() {
+        advance();
+        const BusState &s = current();
+        return (s.read ? (1u << 5) : 0) | (phi2() ? (1u << 6) : 0)
+             | (m_driving ? (1u << 7) : 0) | (s.halt ? (1u << 8) : 0);
+    }
+
+    // --- Outputs ---
+    // `reads` is how many register reads the target macro does first.
+    void drive(uint8_t data, int reads) {
+        charge(reads);
+        if (!m_driving || m_driven != data) m_drivenSince = m_now;
+        m_driving = true;
+        m_driven = data;
+    }
+
+    void listen() {
+        charge(2);
+        m_driving = false;
+    }
+
+    void audio(int channel, uint32_t value) {
+        samples++;
+        if (log) fprintf(log, "%c %u %u\n", channel ? 'R' : 'A', m_now, value);
+    }
+
+    void irq(bool asserted) {
+        if (asserted == m_irq) return;
+        m_irq = asserted;
+        irqEdges++;
+        if (irqEdgeAt) irqEdgeAt->push_back(m_now);
+        if (log) fprintf(log, "I %u %d\n", m_now, asserted ? 1 : 0);
+    }
+
+    void pokeyWrite(uint32_t cycle, uint8_t reg, uint8_t value) {
+        pokeyWrites++;
+        if (sniffed) sniffed->push_back({cycle, reg, value});
+        if (log) fprintf(log, "W %u %02X %02X\n", cycle, reg, value);
+    }
+
+private:
+    std::vector<BusState> m_states;
+    size_t   m_index;
+    uint32_t m_now;
+    uint32_t m_end;      // Cycle the current state ends
+    uint16_t m_prevAddr; // Address of the state before the current one
+    bool     m_driving;
+    uint8_t  m_driven;
+    uint32_t m_drivenSince; // Cycle m_driven went out
+    bool     m_irq;
+
+    // Past the end of the stream the last state holds.
+    const BusState& current() const {
+        static const BusState idle = {0, 0xFF, true, true, 1};
+        if (m_index < m_states.size()) return m_states[m_index];
+        return m_states.empty() ? idle : m_states.back();
+    }
+
+    // Cycles into the current state.
+    uint32_t phase() const { return m_now - (m_end - current().cycles); }
+
+    bool phi2() const { return running() && phase() >= current().cycles / 2; }
+
+    uint16_t addrLines() const {
+        if (running() && phase() < settleCycles) return m_prevAddr;
+        return current().addr;
+    }
+
+    void advance() { step(accessCycles); }
+
+    void step(uint32_t cycles) {
+        m_now += cycles;
+        while (running() && (int32_t)(m_now - m_end) >= 0) {
+            finish();
+        }
+    }
+
+    void charge(int reads) {
+        while (reads-- > 0) advance();
+    }
+
+    // Close the current state: what the console would latch at its end.
+    void finish() {
+        const BusState &s = m_states[m_index];
+        uint32_t start = m_end - s.cycles;
+        if (latched) latched->push_back(m_driving ? m_driven : -1);
+        if (drivenAt) {
+            int32_t at = (int32_t)(m_drivenSince - start);
+            drivenAt->push_back(m_driving && at > 0 ? (uint32_t)at : 0);
+        }
+        if (s.read) {
+            if (m_driving) {
+                driven++;
+                if (log) fprintf(log, "D %u %04X %02X\n", start, s.addr, m_driven);
+            } else if (s.addr >= 0x4000) {
+                missed++;
+                if (log) fprintf(log, "D %u %04X --\n", start, s.addr);
+            }
+        } else if (m_driving) {
+            conflicts++;
+            if (log) fprintf(log, "X %u %04X %02X\n", start, s.addr, s.data);
+        }
+        m_prevAddr = s.addr;
+        m_index++;
+        if (running()) m_end += m_states[m_index].cycles;
+    }
+};
+
+extern HostBus hostBus;
+
+// ROM images are loaded at run time (bus_sim --rom), up to 512K.
+#define ROM_WORDS_MAX (512u * 1024)
+
+// HAL policy over the model (see bus_hal.h). Each call charges the register
+// reads its TeensyBusHal counterpart does, so path costs stay comparable.
+struct HostBusHal {
+    static constexpr uint32_t DATA_BUS_MASK = 0xFFu << 16;
+    static constexpr uint32_t RW_BIT   = 1u << 5;
+    static constexpr uint32_t PHI2_BIT = 1u << 6;
+    static constexpr uint32_t DIR_BIT  = 1u << 7;
+    static constexpr uint32_t HALT_BIT = 1u << 8;
+
+    HAL_INLINE uint32_t gpio6() { return hostBus.readGpio6(); }
+    HAL_INLINE uint32_t gpio7() { return hostBus.readGpio7(); }
+    HAL_INLINE uint32_t gpio9() { return hostBus.readGpio9(); }
+    HAL_INLINE uint32_t cycles() { return hostBus.cycles(); }
+
+    HAL_INLINE void listen() { hostBus.listen(); }
+    HAL_INLINE void drive(uint8_t data) { hostBus.drive(data, 3); }
+    HAL_INLINE void writeData(uint8_t data) { hostBus.drive(data, 1); }
+
+    HAL_INLINE uint32_t dataBase() { return 0; }
+    HAL_INLINE void driveWord(uint32_t word) { hostBus.drive((uint8_t)(word >> 16), 2); }
+    HAL_INLINE void writeWord(uint32_t word) { hostBus.drive((uint8_t)(word >> 16), 0); }
+
+    HAL_INLINE void audio(uint32_t value) { hostBus.audio(0, value); }
+    HAL_INLINE void audioRight(uint32_t value) { hostBus.audio(1, value); }
+    HAL_INLINE void irq(bool asserted) { hostBus.irq(asserted); }
+
+    HAL_INLINE void pokeyWriteHook(uint32_t cycle, uint8_t reg, uint8_t value) {
+        hostBus.pokeyWrite(cycle, reg, value);
+    }
+
+    HAL_INLINE bool running() { return hostBus.running(); }
+
+    static void logInit() {}
+    static void logBegin() {}
+    static void logEnd() {}
+
+    template <typename... Args>
+    static void logPrintf(const char *format, Args... args) { fprintf(stderr, format, args...); }
+};
+
+#endif // HOST_GPIO_H
@@ -0,0 +1,507 @@
+// POKEY synthesis benchmarks: host timings and output checks for the
+// kernels in lib/Pokey, so a change to them can be measured again.
+//
+// Build from the repository root:
+//   g++ -O2 -std=gnu++14 -Ilib/Pokey tools/bus_sim/pokey_bench.cpp
+//       lib/Pokey/*.cpp -o pokey_bench
+//
+// Usage:
+//   pokey_bench render [N]   Render() against nine TickStep() calls per
+//                            sample, N samples per patch (default 2000000):
+//                            ns/sample for each and whether the outputs match
+//   pokey_bench events [N]   a tracker-style register stream (four channels
+//                            retuned every frame, a noise drum) played at
+//                            three octaves through the event-driven Render()
+//                            and through per-tick TickStep(): ns/sample
+//                            against channel edges per 1000 samples
+//   pokey_bench audctl [N]   the "chord" patch under each AUDCTL mode (15 kHz
+//                            base, 1.79 MHz channels, joined pairs, high-pass,
+//                            9-bit poly): ns/sample for Render() and
+//                            TickStep(), and a check that a volume-only
+//                            channel stays a constant level in every mode
+//   pokey_bench blep [N]     PokeyBlep at 44.1 kHz against point-sampling the
+//                            64 kHz tick stream: alias level (energy off the
+//                            tone's harmonics, dB below the harmonics) for
+//                            three pure tones, then host time per second of
+//                            audio for each path
+//   pokey_bench dual [N]     one Pokey, two Pokeys and the packed DualPokey
+//                            (TickStep() and Render()) per sample, "chord"
+//                            on the left chip under each AUDCTL mode and
+//                            "music" with a volume-only channel on the right
+//                            under another; DualPokey must match two Pokeys
+//                            exactly
+//
+// Host timings only rank the kernels; cycle counts on the Teensy come from
+// the -DBUS_STATS build. Every mode exits non-zero if an output check fails.
+
+#include "pokey.h"
+#include "pokey_blep.h"
+#include "dual_pokey.h"
+#include <chrono>
+#include <complex>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+struct Patch {
+    const char *name;
+    uint8_t     regs[9];   // AUDF1, AUDC1, ... AUDF4, AUDC4, AUDCTL
+};
+
+// Register sets covering the kernel's fast paths: silence, pure tones
+// (one memset per edge), poly distortions (per-sample mix) and
+// volume-only channels (no timers).
+static const Patch patches[] = {
+    { "silent",    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 } },
+    { "tone",      { 0x50, 0xA8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 } },
+    { "chord",     { 0x50, 0xA8, 0x40, 0xA6, 0x35, 0xA4, 0x28, 0xA2, 0x00 } },
+    { "music",     { 0x50, 0xA8, 0x79, 0x26, 0x0C, 0x84, 0xF0, 0x02, 0x00 } },
+    { "volume",    { 0x00, 0x18, 0x00, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00 } },
+};
+
+static double nowNs() {
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void applyPatch(Pokey &pokey, const Patch &patch) {
+    pokey.Reset();
+    pokey.Write(0x08, patch.regs[8]);
+    for (int r = 0; r < 8; r++) pokey.Write((uint8_t)r, patch.regs[r]);
+    pokey.Write(0x09, 0);  // STIMER: start every channel from its divisor
+}
+
+// Block size of the firmware's render-ahead buffer.
+#define RENDER_BLOCK 64
+
+static double timeRender(Pokey &pokey, uint8_t *out, size_t samples) {
+    double start = nowNs();
+    for (size_t n = 0; n < samples; n += RENDER_BLOCK) {
+        size_t count = samples - n < RENDER_BLOCK ? samples - n : RENDER_BLOCK;
+        pokey.Render(out + n, count);
+    }
+    return (nowNs() - start) / (double)samples;
+}
+
+static double timeTickStep(Pokey &pokey, uint8_t *out, size_t samples) {
+    double start = nowNs();
+    size_t n = 0;
+    while (n < samples) {
+        if (pokey.TickStep()) out[n++] = pokey.GetOutput();
+    }
+    return (nowNs() - start) / (double)samples;
+}
+
+static bool benchRender(size_t samples) {
+    std::vector<uint8_t> rendered(samples), stepped(samples);
+    bool ok = true;
+
+    printf("%-8s %12s %12s  %s\n", "patch", "Render ns", "TickStep ns", "output");
+    for (const Patch &patch : patches) {
+        Pokey pokey;
+        applyPatch(pokey, patch);
+        double render = timeRender(pokey, rendered.data(), samples);
+        applyPatch(pokey, patch);
+        double step = timeTickStep(pokey, stepped.data(), samples);
+
+        bool same = memcmp(rendered.data(), stepped.data(), samples) == 0;
+        ok = ok && same;
+        printf("%-8s %12.2f %12.2f  %s\n", patch.name, render, step,
+               same ? "identical" : "MISMATCH");
+    }
+    return ok;
+}
+
+// One register write, applied before output sample `sample`.
+struct RegWrite {
+    uint32_t sample;
+    uint8_t  reg;
+    uint8_t  value;
+};
+
+// Samples per 60 Hz frame at the 63.9 kHz tick rate.
+#define FRAME_SAMPLES 1065
+
+// What a tracker driver writes: a melody and a bass line in pure tones (one
+// note every 8 frames, volume decaying), a poly-distorted pad on channel 3
+// and a 4-frame noise drum on channel 4 every 16 frames. `shift` lowers the
+// dividers by octaves, doubling the edge rate each step.
+static std::vector<RegWrite> musicStream(size_t samples, int shift) {
+    static const uint8_t melody[16] = {
+        0x79, 0x6C, 0x60, 0x5B, 0x51, 0x48, 0x40, 0x3C,
+        0x40, 0x48, 0x51, 0x5B, 0x60, 0x6C, 0x79, 0x88 };
+    static const uint8_t bass[4] = { 0xF3, 0xD8, 0xC1, 0xB6 };
+
+    std::vector<RegWrite> writes;
+    for (uint32_t frame = 0; (size_t)frame * FRAME_SAMPLES < samples; frame++) {
+        uint32_t at = frame * FRAME_SAMPLES;
+        uint32_t step = frame / 8;
+        uint8_t decay = (uint8_t)(frame % 8);
+        writes.push_back({ at, 0x00, (uint8_t)(melody[step % 16] >> shift) });
+        writes.push_back({ at, 0x01, (uint8_t)(0xA0 | (10 - decay)) });
+        writes.push_back({ at, 0x02, (uint8_t)(bass[(step / 4) % 4] >> shift) });
+        writes.push_back({ at, 0x03, (uint8_t)(0xA0 | 8) });
+        writes.push_back({ at, 0x04, (uint8_t)(melody[(step + 4) % 16] >> shift) });
+        writes.push_back({ at, 0x05, (uint8_t)(0xC0 | 3) });
+        bool drum = frame % 16 < 4;
+        writes.push_back({ at, 0x06, 0x08 });
+        writes.push_back({ at, 0x07, (uint8_t)(drum ? 12 - 3 * (frame % 16) : 0) });
+    }
+    return writes;
+}
+
+// Channel divider underflows in the stream: each is one edge the
+// event-driven kernel stops for.
+static double edgesPer1000(const std::vector<RegWrite> &writes, size_t samples) {
+    uint8_t regs[8] = { 0 };
+    double edges = 0;
+    size_t w = 0;
+    for (size_t n = 0; n < samples; ) {
+        while (w < writes.size() && writes[w].sample <= n) {
+            regs[writes[w].reg] = writes[w].value;
+            w++;
+        }
+        size_t end = w < writes.size() ? writes[w].sample : samples;
+        if (end > samples) end = samples;
+        for (int i = 0; i < 4; i++) {
+            if (!(regs[i * 2 + 1] & 0x10)) edges += (double)(end - n) / (regs[i * 2] + 1);
+        }
+        n = end;
+    }
+    return edges * 1000.0 / (double)samples;
+}
+
+static double playRender(const std::vector<RegWrite> &writes, uint8_t *out, size_t samples) {
+    Pokey pokey;
+    size_t w = 0;
+    double start = nowNs();
+    for (size_t n = 0; n < samples; ) {
+        while (w < writes.size() && writes[w].sample <= n) {
+            pokey.Write(writes[w].reg, writes[w].value);
+            w++;
+        }
+        size_t end = w < writes.size() ? writes[w].sample : samples;
+        if (end > samples) end = samples;
+        pokey.Render(out + n, end - n);
+        n = end;
+    }
+    return (nowNs() - start) / (double)samples;
+}
+
+static double playTickStep(const std::vector<RegWrite> &writes, uint8_t *out, size_t samples) {
+    Pokey pokey;
+    size_t w = 0;
+    double start = nowNs();
+    for (size_t n = 0; n < samples; ) {
+        while (w < writes.size() && writes[w].sample <= n) {
+            pokey.Write(writes[w].reg, writes[w].value);
+            w++;
+        }
+        if (pokey.TickStep()) out[n++] = pokey.GetOutput();
+    }
+    return (nowNs() - start) / (double)samples;
+}
+
+static bool benchEvents(size_t samples) {
+    std::vector<uint8_t> rendered(samples), stepped(samples);
+    bool ok = true;
+
+    printf("%-8s %12s %12s %12s  %s\n", "octave", "edges/1000", "Render ns",
+           "TickStep ns", "output");
+    for (int shift = 0; shift < 3; shift++) {
+        std::vector<RegWrite> writes = musicStream(samples, shift);
+        double event = playRender(writes, rendered.data(), samples);
+        double tick = playTickStep(writes, stepped.data(), samples);
+
+        bool same = memcmp(rendered.data(), stepped.data(), samples) == 0;
+        ok = ok && same;
+        printf("%-8d %12.1f %12.2f %12.2f  %s\n", shift,
+               edgesPer1000(writes, samples), event, tick,
+               same ? "identical" : "MISMATCH");
+    }
+    return ok;
+}
+
+struct AudctlMode {
+    const char *name;
+    uint8_t     audctl;
+};
+
+static const AudctlMode audctlModes[] = {
+    { "off",        0x00 },
+    { "15khz",      0x01 },
+    { "ch1-1.79",   0x40 },
+    { "join12",     0x50 },
+    { "join-both",  0x18 },
+    { "highpass",   0x06 },
+    { "poly9",      0x80 },
+};
+
+static bool benchAudctl(size_t samples) {
+    std::vector<uint8_t> rendered(samples), stepped(samples);
+    bool ok = true;
+
+    printf("%-10s %6s %12s %12s  %-9s  %s\n", "mode", "AUDCTL", "Render ns",
+           "TickStep ns", "output", "volume-only");
+    for (const AudctlMode &mode : audctlModes) {
+        Patch patch = patches[2];  // chord
+        patch.regs[8] = mode.audctl;
+
+        Pokey pokey;
+        applyPatch(pokey, patch);
+        double render = timeRender(pokey, rendered.data(), samples);
+        applyPatch(pokey, patch);
+        double step = timeTickStep(pokey, stepped.data(), samples);
+        bool same = memcmp(rendered.data(), stepped.data(), samples) == 0;
+
+        // Channel 1 volume-only at 8, channels 2-4 running silent: the
+        // high-pass and pair muting must leave channel 1 at a constant 8.
+        Patch level = { "level", { 0x10, 0xF8, 0x20, 0xA0, 0x07, 0xA0, 0x30, 0xA0,
+                                   mode.audctl } };
+        applyPatch(pokey, level);
+        pokey.Render(rendered.data(), samples);
+        bool constant = true;
+        for (size_t n = 0; n < samples; n++) {
+            if (rendered[n] != 8) constant = false;
+        }
+
+        ok = ok && same && constant;
+        printf("%-10s %6.2X %12.2f %12.2f  %-9s  %s\n", mode.name, mode.audctl,
+               render, step, same ? "identical" : "MISMATCH",
+               constant ? "constant" : "MISMATCH");
+    }
+    return ok;
+}
+
+// In-place radix-2 FFT; `data.size()` must be a power of two.
+static void fft(std::vector<std::complex<double> > &data) {
+    size_t n = data.size();
+    for (size_t i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) std::swap(data[i], data[j]);
+    }
+    for (size_t len = 2; len <= n; len <<= 1) {
+        std::complex<double> w(cos(-2 * M_PI / len), sin(-2 * M_PI / len));
+        for (size_t i = 0; i < n; i += len) {
+            std::complex<double> wk(1, 0);
+            for (size_t k = 0; k < len / 2; k++) {
+                std::complex<double> a = data[i + k], b = data[i + k + len / 2] * wk;
+                data[i + k] = a + b;
+                data[i + k + len / 2] = a - b;
+                wk *= w;
+            }
+        }
+    }
+}
+
+// A tone with period 2 * (AUDF + 1) ticks only has lines at multiples of
+// its fundamental; after resampling, whatever lands elsewhere is aliasing.
+// Returns the energy off those lines in dB relative to the energy on them.
+static double aliasDb(const uint8_t *samples, size_t count, double rate, double tone) {
+    std::vector<std::complex<double> > bins(count);
+    double mean = 0;
+    for (size_t n = 0; n < count; n++) mean += samples[n];
+    mean /= (double)count;
+    for (size_t n = 0; n < count; n++) {
+        double hann = 0.5 - 0.5 * cos(2 * M_PI * (double)n / (double)count);
+        bins[n] = std::complex<double>((samples[n] - mean) * hann, 0);
+    }
+    fft(bins);
+
+    double onLines = 0, offLines = 0;
+    double binHz = rate / (double)count;
+    for (size_t k = 1; k < count / 2; k++) {
+        double hz = (double)k * binHz;
+        double harmonic = floor(hz / tone + 0.5) * tone;
+        double power = std::norm(bins[k]);
+        if (harmonic > 0 && fabs(hz - harmonic) <= 4 * binHz) {
+            onLines += power;
+        } else {
+            offLines += power;
+        }
+    }
+    return 10 * log10((offLines + 1e-12) / onLines);
+}
+
+#define BLEP_RATE   44100
+#define BLEP_WINDOW 16384
+
+static void blepOutput(const Patch &patch, uint8_t *out, size_t count) {
+    Pokey pokey;
+    PokeyBlep blep;
+    applyPatch(pokey, patch);
+    blep.SetOutputRate(BLEP_RATE);
+    for (size_t n = 0; n < count; n += PokeyBlep::MAX_BLOCK) {
+        size_t chunk = count - n < (size_t)PokeyBlep::MAX_BLOCK ? count - n : (size_t)PokeyBlep::MAX_BLOCK;
+        blep.Render(pokey, out + n, chunk);
+    }
+}
+
+// The same ticks taken at the output rate with no filtering: the nearest
+// earlier tick for each output sample.
+static void pointSampledOutput(const Patch &patch, uint8_t *out, size_t count) {
+    size_t tickCount = (size_t)((double)count * PokeyBlep::TICK_RATE / BLEP_RATE) + 2;
+    std::vector<uint8_t> ticks(tickCount);
+    Pokey pokey;
+    applyPatch(pokey, patch);
+    pokey.Render(ticks.data(), tickCount);
+    for (size_t n = 0; n < count; n++) {
+        out[n] = ticks[(size_t)((uint64_t)n * PokeyBlep::TICK_RATE / BLEP_RATE)];
+    }
+}
+
+static bool benchBlep(size_t samples) {
+    static const uint8_t tones[] = { 2, 5, 11 };  // AUDF for 10.7, 5.3, 2.7 kHz
+    const size_t skip = 1024;                     // Past the kernel delay
+    std::vector<uint8_t> out(BLEP_WINDOW + skip);
+    bool ok = true;
+
+    printf("%-10s %14s %14s\n", "tone Hz", "point dB", "blep dB");
+    for (uint8_t audf : tones) {
+        Patch patch = { "tone", { audf, 0xAF, 0, 0, 0, 0, 0, 0, 0 } };
+        double tone = (double)PokeyBlep::TICK_RATE / (2.0 * (audf + 1));
+
+        pointSampledOutput(patch, out.data(), out.size());
+        double point = aliasDb(out.data() + skip, BLEP_WINDOW, BLEP_RATE, tone);
+        blepOutput(patch, out.data(), out.size());
+        double blep = aliasDb(out.data() + skip, BLEP_WINDOW, BLEP_RATE, tone);
+
+        ok = ok && blep < point;
+        printf("%-10.0f %14.1f %14.1f\n", tone, point, blep);
+    }
+
+    // Throughput: one second of audio is TICK_RATE ticks for the plain path
+    // and BLEP_RATE samples (plus the ticks they pull) for PokeyBlep.
+    std::vector<uint8_t> buffer(samples);
+    printf("\n%-10s %14s %14s\n", "patch", "tick us/s", "blep us/s");
+    for (const Patch &patch : patches) {
+        Pokey pokey;
+        applyPatch(pokey, patch);
+        double tick = timeRender(pokey, buffer.data(), samples) * PokeyBlep::TICK_RATE / 1000.0;
+
+        size_t outCount = (size_t)((uint64_t)samples * BLEP_RATE / PokeyBlep::TICK_RATE);
+        double start = nowNs();
+        blepOutput(patch, buffer.data(), outCount);
+        double blep = (nowNs() - start) / (double)outCount * BLEP_RATE / 1000.0;
+        printf("%-10s %14.1f %14.1f\n", patch.name, tick, blep);
+    }
+    return ok;
+}
+
+static void applyDualPatch(DualPokey &dual, const Patch &left, const Patch &right) {
+    dual.Reset();
+    for (int chip = 0; chip < 2; chip++) {
+        const Patch &patch = chip ? right : left;
+        uint8_t base = (uint8_t)(chip << 4);
+        dual.Write(base | 0x08, patch.regs[8]);
+        for (int r = 0; r < 8; r++) dual.Write((uint8_t)(base | r), patch.regs[r]);
+        dual.Write(base | 0x09, 0);
+    }
+}
+
+static bool benchDual(size_t samples) {
+    std::vector<uint8_t> left(samples), right(samples), refLeft(samples), refRight(samples);
+    const size_t modes = sizeof(audctlModes) / sizeof(audctlModes[0]);
+    bool ok = true;
+
+    printf("%-10s %-10s %10s %10s %10s %10s %10s  %s\n", "left", "right", "1x step",
+           "2x step", "dual step", "2x render", "dual rndr", "output");
+    for (size_t m = 0; m < modes; m++) {
+        const AudctlMode &mode = audctlModes[m];
+        const AudctlMode &other = audctlModes[(m + 3) % modes];
+        Patch patch = patches[2];  // chord
+        patch.regs[8] = mode.audctl;
+        Patch music = patches[3];
+        music.regs[7] = 0x14;      // Channel 4 volume-only
+        music.regs[8] = other.audctl;
+
+        Pokey one, two;
+        applyPatch(one, patch);
+        double single = timeTickStep(one, refLeft.data(), samples);
+        applyPatch(one, patch);
+        applyPatch(two, music);
+        double start = nowNs();
+        for (size_t n = 0; n < samples; ) {
+            bool done = one.TickStep();
+            two.TickStep();
+            if (done) {
+                refLeft[n] = one.GetOutput();
+                refRight[n] = two.GetOutput();
+                n++;
+            }
+        }
+        double pairStep = (nowNs() - start) / (double)samples;
+
+        DualPokey dual;
+        applyDualPatch(dual, patch, music);
+        start = nowNs();
+        for (size_t n = 0; n < samples; ) {
+            if (dual.TickStep()) {
+                left[n] = dual.GetOutput(0);
+                right[n] = dual.GetOutput(1);
+                n++;
+            }
+        }
+        double dualStep = (nowNs() - start) / (double)samples;
+        bool same = memcmp(left.data(), refLeft.data(), samples) == 0
+                    && memcmp(right.data(), refRight.data(), samples) == 0;
+
+        applyPatch(one, patch);
+        applyPatch(two, music);
+        start = nowNs();
+        for (size_t n = 0; n < samples; n += RENDER_BLOCK) {
+            size_t count = samples - n < RENDER_BLOCK ? samples - n : RENDER_BLOCK;
+            one.Render(refLeft.data() + n, count);
+            two.Render(refRight.data() + n, count);
+        }
+        double pairRender = (nowNs() - start) / (double)samples;
+
+        applyDualPatch(dual, patch, music);
+        start = nowNs();
+        for (size_t n = 0; n < samples; n += RENDER_BLOCK) {
+            size_t count = samples - n < RENDER_BLOCK ? samples - n : RENDER_BLOCK;
+            dual.Render(left.data() + n, right.data() + n, count);
+        }
+        double dualRender = (nowNs() - start) / (double)samples;
+        same = same && memcmp(left.data(), refLeft.data(), samples) == 0
+               && memcmp(right.data(), refRight.data(), samples) == 0;
+
+        ok = ok && same;
+        printf("%-10s %-10s %10.2f %10.2f %10.2f %10.2f %10.2f  %s\n", mode.name, other.name,
+               single, pairStep,
+               dualStep, pairRender, dualRender, same ? "identical" : "MISMATCH");
+    }
+    return ok;
+}
+
+static void usage() {
+    fprintf(stderr, "usage: pokey_bench render|events|audctl|blep|dual [samples]\n");
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) usage();
+    size_t samples = argc > 2 ? (size_t)strtoul(argv[2], NULL, 0) : 2000000;
+    if (samples == 0) usage();
+
+    bool ok;
+    if (!strcmp(argv[1], "render")) {
+        ok = benchRender(samples);
+    } else if (!strcmp(argv[1], "events")) {
+        ok = benchEvents(samples);
+    } else if (!strcmp(argv[1], "audctl")) {
+        ok = benchAudctl(samples);
+    } else if (!strcmp(argv[1], "blep")) {
+        ok = benchBlep(samples);
+    } else if (!strcmp(argv[1], "dual")) {
+        ok = benchDual(samples);
+    } else {
+        usage();
+        return 2;
+    }
+    return ok ? 0 : 1;
+}
@@ -14,6 +14,9 @@ def convert_a78_to_header(input_file, output_file):
     # Clean up game name
     game_name = header[0x11:0x31].decode('ascii', errors='ignore').replace('\x00', '').strip()
     
+    # The header goes into the image as ROM_HEADER and the firmware decodes
+    # it at boot (include/a78_header.h: mapper, POKEY address, TV type).
+    # tools/bus_sim --rom game.a78 --check-load prints the same decode.
     print(f"Game: {game_name}")
     print(f"ROM Size: {rom_size} bytes")
 
@@ -21,7 +24,14 @@ def convert_a78_to_header(input_file, output_file):
         name_def = "GAME_ROM_H"
         f.write(f"#ifndef {name_def}\n#define {name_def}\n\n")
         f.write(f"// Game: {game_name}\n")
-        f.write(f"const uint32_t ROM_SIZE = {rom_size};\n\n")
+        f.write(f"const uint32_t ROM_SIZE = {rom_size};\n")
+        f.write("\n")
+        f.write("#define ROM_HAS_HEADER 1\n")
+        f.write("const uint8_t ROM_HEADER[128] = {\n")
+        for i in range(0, 128, 16):
+            f.write("    " + ", ".join(f"0x{b:02X}" for b in header[i:i+16]))
+            f.write(",\n" if i + 16 < 128 else "\n")
+        f.write("};\n\n")
         f.write(f"const uint8_t ROM_DATA[{rom_size}] = {{\n")
         
         for i in range(0, rom_size, 16):
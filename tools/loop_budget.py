@@ -0,0 +1,452 @@
+#!/usr/bin/env python3
+"""
+Worst-case cycle budget for the bus loop.
+
+Disassembles the compiled loop() (FASTRUN, in ITCM), finds every address
+read (the GPIO7_PSR load holding A0-A7) and every point where data reaches
+the bus: a str to GPIO6_DR, and a str to GPIO6_GDIR of an orr-built value
+(the direction flip of the first drive; the bic in listen() is skipped).
+Reports the longest instruction path from a read to each of them, and
+flags any that is over budget or has a call on it (a helper that stopped
+being inlined).
+
+Report-only for now: the check has not yet been run on a real firmware.elf,
+and the budgets below are placeholders, not measurements. Set them from the
+per-branch figures this prints for real release and diagnostic builds,
+then turn on custom_loop_budget_enforce (or --enforce by hand) to fail the
+build on a flagged path.
+
+Paths are searched exactly: only instructions that can reach the store
+without passing another address read are considered, a longest-path pass
+runs over them when they form no loop, and every simple path is walked
+(up to MAX_PATHS, past which the store is flagged) when they do.
+
+Cycles come from a static Cortex-M7 model, deliberately pessimistic: no
+dual issue, every load waits for its data, every conditional branch pays a
+partial flush. It is there to catch a change that lengthens the drive
+path; compare against -DBUS_STATS drive histograms for real numbers. One
+bus cycle is ~456 CPU cycles at 816 MHz.
+
+Runs after every PlatformIO build (platformio.ini):
+    extra_scripts = post:tools/loop_budget.py
+    custom_loop_budget = 150
+    custom_loop_budget_diag = 400
+    ; custom_loop_budget_enforce = yes
+
+Builds with -DBUS_TRACE or -DBUS_STATS put capture and histogram code on
+the drive paths on purpose; they are checked against
+custom_loop_budget_diag instead, and calls there (the dumps) are listed
+but not flagged.
+
+Or by hand (--diag for a BUS_TRACE/BUS_STATS build):
+    python3 tools/loop_budget.py .pio/build/teensy41/firmware.elf [budget] [objdump] [--diag] [--enforce]
+"""
+
+import re
+import subprocess
+import sys
+
+DEFAULT_BUDGET = 150          # Placeholders until measured on a real build
+DEFAULT_DIAG_BUDGET = 400
+DIAG_DEFINES = ('BUS_TRACE', 'BUS_STATS')
+MAX_PATHS = 1000000     # Simple paths walked per store when the region loops
+
+GPIO6_DR   = 0x42000000
+GPIO6_GDIR = 0x42000004
+GPIO7_PSR = 0x42004008
+IO_START, IO_END = 0x40000000, 0x60000000
+
+CYCLES_ALU = 1
+CYCLES_DIV = 12
+CYCLES_LOAD = 2        # TCM, per register
+CYCLES_LOAD_IO = 6     # GPIO/peripheral register (same as tools/bus_sim)
+CYCLES_STORE = 1       # Per register; the write buffer absorbs it
+CYCLES_BRANCH = 3      # Conditional, taken or not
+CYCLES_JUMP = 2        # Unconditional
+CYCLES_BARRIER = 6     # dsb/dmb/isb: waits for the peripheral write
+
+LOOP_SYMBOLS = ('_Z4loopv', 'loop', 'loop()')
+CONDS = {'eq', 'ne', 'cs', 'hs', 'cc', 'lo', 'mi', 'pl', 'vs', 'vc',
+         'hi', 'ls', 'ge', 'lt', 'gt', 'le', 'al'}
+# IT-block instructions carry a condition suffix ('ldrne'); only these
+# prefixes are stripped, so 'movs' and 'lsls' stay as they are.
+CONDITIONAL = ('ldr', 'str', 'mov', 'add', 'sub', 'orr', 'and', 'eor', 'bic')
+NO_DEST = ('push', 'cmp', 'cmn', 'tst', 'teq', 'dsb', 'dmb', 'isb', 'nop',
+           'cpsid', 'cpsie', 'pld', 'bx', 'cbz', 'cbnz', 'tbb', 'tbh', 'udf',
+           'bkpt', 'wfi')
+CALL_CLOBBERS = ('r0', 'r1', 'r2', 'r3', 'r12', 'lr')
+
+
+class Insn:
+    def __init__(self, addr, mnemonic, operands, line):
+        self.addr = addr
+        self.mnemonic = mnemonic
+        self.operands = operands
+        self.line = line        # file:line from objdump -l, or None
+        self.succ = []
+        self.cost = CYCLES_ALU
+        self.mem = None         # Constant address of a load/store, if known
+        self.call = False
+
+    def base(self):
+        """Mnemonic without width or condition suffix ('ldr.w' -> 'ldr')."""
+        m = self.mnemonic.split('.')[0]
+        if m[-2:] in CONDS and m[:-2].startswith(CONDITIONAL):
+            m = m[:-2]
+        return m
+
+
+def parse_int(text):
+    return int(text.lstrip('#'), 0) & 0xFFFFFFFF
+
+
+def registers(text):
+    """Registers named in a {..} list."""
+    m = re.search(r'\{([^}]*)\}', text)
+    return [r.strip() for r in m.group(1).split(',')] if m else []
+
+
+def disassemble(objdump, elf):
+    """Instructions and literal words of loop()."""
+    out = subprocess.run([objdump, '-d', '-l', '--no-show-raw-insn', elf],
+                         stdout=subprocess.PIPE, universal_newlines=True, check=True).stdout
+    insns, words, found, line = [], {}, False, None
+    for text in out.splitlines():
+        header = re.match(r'^([0-9a-f]+) <([^>]+)>:', text)
+        if header:
+            if header.group(2).startswith('$'):
+                continue    # llvm-objdump mapping symbol ($t, $d)
+            if found:
+                break
+            found = header.group(2) in LOOP_SYMBOLS
+            continue
+        if not found:
+            continue
+        src = re.match(r'^;?\s*(\S+):(\d+)(\s+\(discriminator \d+\))?\s*$', text)
+        if src:
+            line = '%s:%s' % (src.group(1).split('/')[-1], src.group(2))
+            continue
+        word = re.match(r'^\s*([0-9a-f]+):.*\s\.word\s+(0x[0-9a-f]+)', text)
+        if word:
+            words[int(word.group(1), 16)] = parse_int(word.group(2))
+            continue
+        m = re.match(r'^\s*([0-9a-f]+):\s+(\S+)\s*(.*)$', text)
+        if not m:
+            continue
+        addr = int(m.group(1), 16)
+        operands = re.split(r'\s[@;]', m.group(3))[0].strip()
+        if not m.group(2).startswith('.'):
+            insns.append(Insn(addr, m.group(2), operands, line))
+    if not found:
+        raise SystemExit('loop_budget: no loop() in %s' % elf)
+    return insns, words
+
+
+def link(insns):
+    """Successor edges and branch costs."""
+    index = {i.addr: n for n, i in enumerate(insns)}
+    for n, i in enumerate(insns):
+        m = i.mnemonic.split('.')[0]
+        nxt = [n + 1] if n + 1 < len(insns) else []
+        target = re.match(r'^(?:0x)?([0-9a-f]+)\b', i.operands.split(',')[-1].strip())
+        dest = [index[int(target.group(1), 16)]] if target and int(target.group(1), 16) in index else []
+        if m in ('bl', 'blx'):
+            i.call = True
+            i.succ = nxt
+        elif m == 'b':
+            i.cost = CYCLES_JUMP
+            i.succ = dest
+        elif m[0] == 'b' and m[1:] in CONDS or m in ('cbz', 'cbnz'):
+            i.cost = CYCLES_BRANCH
+            i.succ = dest + nxt
+        elif m in ('bx', 'tbb', 'tbh') or 'pc' in registers(i.operands) \
+                or re.match(r'^pc\b', i.operands):
+            i.succ = []   # Return, or a jump table this model does not follow
+        else:
+            i.succ = nxt
+
+
+def constants(insns, words):
+    """Forward constant propagation over registers; sets Insn.mem."""
+    state = {0: {}}
+    work = [0]
+    while work:
+        n = work.pop()
+        i = insns[n]
+        regs = dict(state[n])
+        ops = [o.strip() for o in re.split(r',(?![^\[]*\])', i.operands)]
+        b = i.base()
+        # [base], [base, #imm]; a register index leaves the address unknown.
+        mem = re.search(r'\[(\w+)(?:,\s*([^\]]+))?\]', i.operands)
+        if mem and (b.startswith('ldr') or b.startswith('str')):
+            base, index = mem.group(1), mem.group(2)
+            if index is None or index.startswith('#'):
+                off = parse_int(index) if index else 0
+                if base == 'pc':
+                    i.mem = ((i.addr + 4) & ~3) + off
+                elif base in regs:
+                    i.mem = (regs[base] + off) & 0xFFFFFFFF
+        branch = i.succ != [n + 1] or i.call
+        writes = not (b in NO_DEST or b.startswith(('str', 'stm', 'it')) or (branch and b != 'pop'))
+        dest = ops[0] if ops and writes else None
+        value = None
+        if b in ('mov', 'movs', 'movw') and len(ops) == 2:
+            value = parse_int(ops[1]) if ops[1].startswith('#') else regs.get(ops[1])
+        elif b in ('mvn', 'mvns') and len(ops) == 2 and ops[1].startswith('#'):
+            value = ~parse_int(ops[1]) & 0xFFFFFFFF
+        elif b == 'movt' and ops[0] in regs:
+            value = (regs[ops[0]] & 0xFFFF) | (parse_int(ops[1]) << 16)
+        elif b in ('add', 'adds', 'sub', 'subs', 'addw', 'subw') and ops[-1].startswith('#'):
+            src = ops[1] if len(ops) == 3 else ops[0]
+            if src in regs:
+                k = parse_int(ops[-1])
+                value = (regs[src] + (k if b.startswith('add') else -k)) & 0xFFFFFFFF
+        elif b == 'ldr' and i.mem is not None and i.mem in words:
+            value = words[i.mem]
+        if dest:
+            for r in registers(i.operands) if b in ('pop', 'ldm', 'ldmia') else [dest] + (ops[1:2] if b == 'ldrd' else []):
+                regs.pop(r, None)
+            if value is not None:
+                regs[dest] = value
+        if mem and ('!' in i.operands or '],' in i.operands):
+            regs.pop(mem.group(1), None)
+        if i.call:
+            for r in CALL_CLOBBERS:
+                regs.pop(r, None)
+        for s in i.succ:
+            if s not in state:
+                state[s] = regs
+                work.append(s)
+            else:
+                merged = {r: v for r, v in state[s].items() if regs.get(r) == v}
+                if merged != state[s]:
+                    state[s] = merged
+                    work.append(s)
+
+
+def cost(i):
+    b = i.base()
+    count = max(1, len(registers(i.operands)))
+    if b.startswith('ldr') or b.startswith('ldm') or b == 'pop':
+        io = i.mem is not None and IO_START <= i.mem < IO_END
+        return (CYCLES_LOAD_IO if io else CYCLES_LOAD) * (2 if b == 'ldrd' else count)
+    if b.startswith('str') or b.startswith('stm') or b == 'push':
+        return CYCLES_STORE * (2 if b == 'strd' else count)
+    if b in ('dsb', 'dmb', 'isb'):
+        return CYCLES_BARRIER
+    if b in ('sdiv', 'udiv'):
+        return CYCLES_DIV
+    return i.cost
+
+
+def region(insns, starts, store):
+    """Instructions that reach `store` without passing another address read."""
+    preds = {}
+    for n, i in enumerate(insns):
+        for t in i.succ:
+            preds.setdefault(t, []).append(n)
+    seen, work = {store}, [store]
+    while work:
+        for p in preds.get(work.pop(), []):
+            if p not in seen and p not in starts:
+                seen.add(p)
+                work.append(p)
+    return seen
+
+
+def acyclic(insns, nodes):
+    """True when the successor edges inside `nodes` form no loop (Kahn)."""
+    degree = {n: 0 for n in nodes}
+    for n in nodes:
+        for t in insns[n].succ:
+            if t in degree:
+                degree[t] += 1
+    work = [n for n, d in degree.items() if d == 0]
+    done = 0
+    while work:
+        n = work.pop()
+        done += 1
+        for t in insns[n].succ:
+            if t in degree:
+                degree[t] -= 1
+                if degree[t] == 0:
+                    work.append(t)
+    return done == len(nodes)
+
+
+def longest_dag(insns, nodes, store):
+    """Longest path from each node to `store`, exact on a loop-free region."""
+    sys.setrecursionlimit(10000)
+    best = {}
+
+    def longest(n):
+        if n not in best:
+            if n == store:
+                best[n] = (insns[n].cost, None)
+            else:
+                tails = [(longest(t)[0], t) for t in insns[n].succ if t in nodes]
+                top = max(tails)
+                best[n] = (insns[n].cost + top[0], top[1])
+        return best[n]
+
+    def path(n):
+        out = []
+        while n is not None:
+            out.append(n)
+            n = longest(n)[1]
+        return out
+
+    return lambda n: (longest(n)[0], path(n))
+
+
+def longest_simple(insns, nodes, store):
+    """Longest simple path from a node to `store`, by walking every one."""
+    def search(first):
+        best, walked = None, 0
+        stack, on = [(first, iter(insns[first].succ))], {first}
+        cycles = insns[first].cost
+        while stack:
+            n, succ = stack[-1]
+            if n == store:
+                walked += 1
+                if walked > MAX_PATHS:
+                    return None
+                if best is None or cycles > best[0]:
+                    best = (cycles, [m for m, _ in stack])
+                t = None
+            else:
+                t = next((t for t in succ if t in nodes and t not in on), None)
+            if t is None:
+                stack.pop()
+                on.discard(n)
+                cycles -= insns[n].cost
+            else:
+                stack.append((t, iter(insns[t].succ)))
+                on.add(t)
+                cycles += insns[t].cost
+        return best
+
+    return search
+
+
+def worst_paths(insns, starts, store):
+    """Longest path from each address read to `store`; other reads end a path.
+    Returns ([(cycles, path)], exact); exact is False when a looping region
+    had more than MAX_PATHS paths."""
+    nodes = region(insns, starts, store)
+    if acyclic(insns, nodes):
+        longest = longest_dag(insns, nodes, store)
+    else:
+        longest = longest_simple(insns, nodes, store)
+    result, exact = [], True
+    for start in starts:
+        tails = [t for t in insns[start].succ if t in nodes]
+        for t in tails:
+            sub = longest(t)
+            if sub is None:
+                exact = False
+                continue
+            result.append((insns[start].cost + sub[0], [start] + sub[1]))
+    return result, exact
+
+
+def producer(insns, n, reg):
+    """Instruction that last set `reg` before `n` in straight-line code."""
+    k = n - 1
+    while k >= 0 and n - k <= 8 and k + 1 in insns[k].succ:
+        ops = [o.strip() for o in re.split(r',(?![^\[]*\])', insns[k].operands)]
+        b = insns[k].base()
+        if ops and ops[0] == reg and not (b in NO_DEST or b.startswith(('str', 'stm'))):
+            return insns[k]
+        k -= 1
+    return None
+
+
+def drives(insns, n):
+    """True for a store that puts data on the bus: any GPIO6_DR store, and a
+    GPIO6_GDIR store unless its value comes from a bic/and (listen)."""
+    i = insns[n]
+    if i.base() != 'str':
+        return False
+    if i.mem == GPIO6_DR:
+        return True
+    if i.mem != GPIO6_GDIR:
+        return False
+    src = producer(insns, n, i.operands.split(',')[0].strip())
+    return src is None or not src.base().startswith(('bic', 'and'))
+
+
+def analyze(objdump, elf, budget, diag=False, enforce=False):
+    insns, words = disassemble(objdump, elf)
+    link(insns)
+    constants(insns, words)
+    for i in insns:
+        i.cost = cost(i)
+
+    starts = {n for n, i in enumerate(insns) if i.base().startswith('ldr') and i.mem == GPIO7_PSR}
+    stores = [n for n, i in enumerate(insns) if drives(insns, n)]
+    print('loop_budget: %d instructions, %d address reads, %d data-bus stores, budget %d cycles%s'
+          % (len(insns), len(starts), len(stores), budget, ' (diagnostic build)' if diag else ''))
+    if not starts or not stores:
+        print('loop_budget: could not find the address read or the data-bus store')
+        return 1 if enforce else 0
+
+    failed = 0
+    worst = 0
+    for store in stores:
+        paths, exact = worst_paths(insns, starts, store)
+        if not exact:
+            failed += 1
+            print('  %08x: more than %d paths through a loop, not checked' % (insns[store].addr, MAX_PATHS))
+        if not paths:
+            continue
+        cycles, path = max(paths)
+        calls = [insns[n] for n in path if insns[n].call]
+        worst = max(worst, cycles)
+        failed += bool(cycles > budget or (calls and not diag))
+        print(('  %08x -> %08x  %-4s %4d cycles  %3d insns  %-24s%s'
+               % (insns[path[0]].addr, insns[store].addr,
+                  'DR' if insns[store].mem == GPIO6_DR else 'GDIR', cycles, len(path),
+                  insns[store].line or '', 'OVER' if cycles > budget else '')).rstrip())
+        for c in calls:
+            print('      call on the drive path at %08x: %s %s' % (c.addr, c.mnemonic, c.operands))
+    verdict = ('FAIL' if enforce else 'over budget (report only)') if failed else 'OK'
+    print('loop_budget: worst %d of %d cycles: %s' % (worst, budget, verdict))
+    return 1 if failed and enforce else 0
+
+
+def diagnostic_build(defines):
+    """True when -DBUS_TRACE or -DBUS_STATS is among PlatformIO CPPDEFINES."""
+    names = [d[0] if isinstance(d, (tuple, list)) else str(d).split('=')[0] for d in defines]
+    return any(name in DIAG_DEFINES for name in names)
+
+
+try:
+    Import('env')  # noqa: F821 (PlatformIO extra script)
+
+    def loop_budget_action(target, source, env):
+        objdump = env.subst('$OBJCOPY').replace('objcopy', 'objdump')
+        diag = diagnostic_build(env.get('CPPDEFINES', []))
+        if diag:
+            budget = int(env.GetProjectOption('custom_loop_budget_diag', str(DEFAULT_DIAG_BUDGET)))
+        else:
+            budget = int(env.GetProjectOption('custom_loop_budget', str(DEFAULT_BUDGET)))
+        enforce = env.GetProjectOption('custom_loop_budget_enforce', 'no').lower() in ('yes', 'true', '1')
+        try:
+            return analyze(objdump, str(target[0]), budget, diag, enforce)
+        except (SystemExit, OSError, subprocess.CalledProcessError) as e:
+            print('loop_budget: not checked: %s' % e)
+            return 1 if enforce else 0
+
+    env.AddPostAction('$BUILD_DIR/${PROGNAME}.elf', loop_budget_action)  # noqa: F821
+except NameError:
+    if __name__ == '__main__':
+        diag = '--diag' in sys.argv
+        enforce = '--enforce' in sys.argv
+        args = [a for a in sys.argv[1:] if a not in ('--diag', '--enforce')]
+        if not args:
+            print('Usage: python3 loop_budget.py <firmware.elf> [budget] [objdump] [--diag] [--enforce]')
+            sys.exit(2)
+        sys.exit(analyze(args[2] if len(args) > 2 else 'arm-none-eabi-objdump', args[0],
+                         int(args[1]) if len(args) > 1 else
+                         (DEFAULT_DIAG_BUDGET if diag else DEFAULT_BUDGET), diag, enforce))